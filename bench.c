@@ -0,0 +1,193 @@
+// bench.c -- flag_parse() throughput benchmark
+//
+//   Measures tokens/second and ns/flag for parsing synthetic argv arrays of
+//   configurable size and type mix, plus the cost of rendering the help, so
+//   lookup and parser changes can be validated against regressions.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FLAG_IMPLEMENTATION
+#include "./flag.h"
+
+#define BENCH_NAME_CAP 32
+
+static double bench_now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec*1e-9;
+}
+
+typedef struct {
+    Flag_Context context;
+    char (*names)[BENCH_NAME_CAP];
+    size_t flags_count;
+
+    char **argv;
+    int argc;
+    size_t flag_hits;           // how many flag occurrences one parse binds
+} Bench;
+
+static void bench_register_flags(Bench *bench, size_t flags_count)
+{
+    memset(&bench->context, 0, sizeof(bench->context));
+    bench->names = (char(*)[BENCH_NAME_CAP]) malloc(flags_count*BENCH_NAME_CAP);
+    assert(bench->names != NULL);
+    bench->flags_count = flags_count;
+
+    for (size_t i = 0; i < flags_count; ++i) {
+        snprintf(bench->names[i], BENCH_NAME_CAP, "flag%zu", i);
+        // NOTE: one third of each supported type
+        switch (i % 3) {
+        case 0: flag_bool_c(&bench->context, bench->names[i], false, "synthetic"); break;
+        case 1: flag_uint64_c(&bench->context, bench->names[i], 0, "synthetic"); break;
+        case 2: flag_str_c(&bench->context, bench->names[i], "", "synthetic"); break;
+        }
+    }
+}
+
+// NOTE: fills bench->argv with up to tokens_count tokens referencing the
+// registered flags either in registration order or shuffled, so both the
+// friendly and the cache-hostile orderings get measured
+static void bench_build_argv(Bench *bench, size_t tokens_count, bool shuffled)
+{
+    static char uint64_value[] = "123456789012345";
+    static char str_value[] = "some-string-value";
+    static char program_name[] = "bench";
+
+    size_t *order = (size_t*) malloc(bench->flags_count*sizeof(size_t));
+    assert(order != NULL);
+    for (size_t i = 0; i < bench->flags_count; ++i) order[i] = i;
+    if (shuffled) {
+        srand(69);
+        for (size_t i = bench->flags_count - 1; i > 0; --i) {
+            size_t j = (size_t) rand() % (i + 1);
+            size_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    bench->argv = (char**) malloc((tokens_count + 2)*sizeof(char*));
+    assert(bench->argv != NULL);
+    bench->argv[0] = program_name;
+
+    size_t argc = 1;
+    size_t next = 0;
+    bench->flag_hits = 0;
+    while (argc < tokens_count + 1) {
+        size_t id = order[next];
+        next = (next + 1) % bench->flags_count;
+
+        // NOTE: dash-name tokens are built once up front; values are separate
+        // tokens so repeated parses don't depend on argv mutation
+        char *dash_name = (char*) malloc(BENCH_NAME_CAP + 1);
+        assert(dash_name != NULL);
+        snprintf(dash_name, BENCH_NAME_CAP + 1, "-%s", bench->names[id]);
+
+        switch (id % 3) {
+        case 0: {
+            bench->argv[argc++] = dash_name;
+        }
+        break;
+        case 1: {
+            if (argc + 2 > tokens_count + 1) { free(dash_name); goto done; }
+            bench->argv[argc++] = dash_name;
+            bench->argv[argc++] = uint64_value;
+        }
+        break;
+        case 2: {
+            if (argc + 2 > tokens_count + 1) { free(dash_name); goto done; }
+            bench->argv[argc++] = dash_name;
+            bench->argv[argc++] = str_value;
+        }
+        break;
+        }
+        bench->flag_hits += 1;
+    }
+done:
+    bench->argv[argc] = NULL;
+    bench->argc = (int) argc;
+    free(order);
+}
+
+static void bench_parse(Bench *bench, const char *label, size_t iterations)
+{
+    double begin = bench_now_sec();
+    for (size_t i = 0; i < iterations; ++i) {
+        if (!flag_parse_c(&bench->context, bench->argc, bench->argv)) {
+            flag_print_error_c(&bench->context, stderr);
+            exit(1);
+        }
+    }
+    double elapsed = bench_now_sec() - begin;
+
+    size_t tokens = (size_t) (bench->argc - 1)*iterations;
+    size_t hits = bench->flag_hits*iterations;
+    printf("%-24s %8.3f ms  %12.0f tokens/s  %8.1f ns/token  %8.1f ns/flag\n",
+           label, elapsed*1e3,
+           (double) tokens/elapsed,
+           elapsed*1e9/(double) tokens,
+           elapsed*1e9/(double) hits);
+}
+
+static void bench_print_options(Bench *bench, size_t iterations)
+{
+    FILE *sink = fopen("/dev/null", "w");
+    assert(sink != NULL);
+
+    double begin = bench_now_sec();
+    for (size_t i = 0; i < iterations; ++i) {
+        flag_print_options_c(&bench->context, sink);
+    }
+    double elapsed = bench_now_sec() - begin;
+    fclose(sink);
+
+    printf("%-24s %8.3f ms  %8.1f us/render\n",
+           "print_options", elapsed*1e3, elapsed*1e6/(double) iterations);
+}
+
+void usage(FILE *stream)
+{
+    fprintf(stream, "Usage: ./bench [OPTIONS]\n");
+    fprintf(stream, "OPTIONS:\n");
+    flag_print_options(stream);
+}
+
+int main(int argc, char **argv)
+{
+    bool *help = flag_bool("help", false, "Print this help to stdout and exit with 0");
+    uint64_t *flags_count = flag_uint64("flags", 200, "How many flags to register");
+    uint64_t *tokens_count = flag_uint64("tokens", 10000, "How many argv tokens to parse per iteration");
+    uint64_t *iterations = flag_uint64("iterations", 200, "How many times to re-parse the argv");
+
+    if (!flag_parse(argc, argv)) {
+        usage(stderr);
+        flag_print_error(stderr);
+        exit(1);
+    }
+
+    if (*help) {
+        usage(stdout);
+        exit(0);
+    }
+
+    printf("flags: %" PRIu64 ", tokens: %" PRIu64 ", iterations: %" PRIu64 "\n",
+           *flags_count, *tokens_count, *iterations);
+
+    Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench_register_flags(&bench, (size_t) *flags_count);
+
+    bench_build_argv(&bench, (size_t) *tokens_count, false);
+    bench_parse(&bench, "parse (ordered)", (size_t) *iterations);
+
+    bench_build_argv(&bench, (size_t) *tokens_count, true);
+    bench_parse(&bench, "parse (shuffled)", (size_t) *iterations);
+
+    bench_print_options(&bench, (size_t) *iterations);
+
+    return 0;
+}
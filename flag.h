@@ -11,44 +11,56 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 #include <inttypes.h>
-#include <limits.h>
 #include <string.h>
-#include <errno.h>
-
-// TODO: add support for -flag=x syntax
-// TODO: *_var function variants
-// void flag_bool_var(bool *var, const char *name, bool def, const char *desc);
-// void flag_bool_uint64(uint64_t *var, const char *name, bool def, const char *desc);
-// etc.
-// WARNING! *_var functions may break the flag_name() functionality
-
-char *flag_name(void *val);
-bool *flag_bool(const char *name, bool def, const char *desc);
-uint64_t *flag_uint64(const char *name, uint64_t def, const char *desc);
-char **flag_str(const char *name, const char *def, const char *desc);
-bool flag_parse(int argc, char **argv);
-int flag_rest_argc(void);
-char **flag_rest_argv(void);
-void flag_print_error(FILE *stream);
-void flag_print_options(FILE *stream);
-
-#endif // FLAG_H_
-
-//////////////////////////////
-
-#ifdef FLAG_IMPLEMENTATION
 
 typedef enum {
     FLAG_BOOL,
     FLAG_UINT64,
     FLAG_STR,
+    FLAG_INT64,
+    FLAG_DOUBLE,
+    FLAG_SIZE,
+    FLAG_STR_LIST,
+    FLAG_KV,
+    FLAG_ENUM,
+    FLAG_DURATION,
+    FLAG_CUSTOM,
 } Flag_Type;
 
+// NOTE: every occurrence of a repeated flag appends to the list, the items
+// alias argv storage just like plain string values
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} Flag_List;
+
+// NOTE: open-addressing hash table populated from repeated -name key=value
+// occurrences. Linear probing over a power-of-two capacity, a NULL key marks
+// an empty slot, keys and values alias argv storage just like plain string
+// values. Repeating a key overwrites its value, last one wins.
+typedef struct {
+    char *key;
+    char *value;
+} Flag_KV_Entry;
+
+typedef struct {
+    Flag_KV_Entry *entries;
+    size_t count;
+    size_t capacity;
+} Flag_KV;
+
 typedef union {
     char *as_str;
     uint64_t as_uint64;
     bool as_bool;
+    int64_t as_int64;
+    double as_double;
+    int as_enum;
+    Flag_List as_list;
+    Flag_KV as_kv;
 } Flag_Value;
 
 typedef enum {
@@ -57,247 +69,2737 @@ typedef enum {
     FLAG_ERROR_NO_VALUE,
     FLAG_ERROR_INVALID_NUMBER,
     FLAG_ERROR_INTEGER_OVERFLOW,
+    FLAG_ERROR_INVALID_BOOLEAN,
+    FLAG_ERROR_RESPONSE_FILE,
+    FLAG_ERROR_AMBIGUOUS,
+    FLAG_ERROR_INVALID_VALUE,
 } Flag_Error;
 
+// NOTE: tokens produced by @response-file expansion
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} Flag_Tokens;
+
+typedef struct {
+    char *items;
+    size_t count;
+    size_t capacity;
+} Flag_String_Builder;
+
+// NOTE: what the last flag_parse() cost. Populated only when the
+// implementation is compiled with FLAG_STATS defined, all zeros otherwise, so
+// production telemetry can be toggled without touching call sites.
+typedef struct {
+    uint64_t tokens_consumed;
+    uint64_t name_comparisons;   // hash probe comparisons while matching names
+    uint64_t conversions;        // numeric conversions performed
+    double parse_seconds;        // wall time of the parse
+} Flag_Stats;
+
+typedef struct Flag_Context Flag_Context;
+
+// NOTE: called by flag_parse() right after the subcommand is identified, so
+// only the flags of the command that actually runs get registered
+typedef void (*Flag_Subcommand_Fn)(Flag_Context *c);
+
+// NOTE: parser for FLAG_CUSTOM values: decode value straight into target and
+// return whether it was valid
+typedef bool (*Flag_Custom_Fn)(const char *value, void *target);
+
+typedef struct {
+    char *name;
+    char *desc;
+    Flag_Subcommand_Fn register_fn;
+} Flag_Subcommand;
+
 typedef struct {
     Flag_Type type;
     char *name;
+    size_t name_len;
+    uint64_t name_hash;
     char *desc;
     Flag_Value val;
     Flag_Value def;
+    // NOTE: where parsed values get written. Points back at &val unless a
+    // *_var variant registered user-owned storage.
+    void *var;
+    // NOTE: registration order, doubles as the flag's bit position in the
+    // provided bitset
+    size_t id;
+    // NOTE: optional single-char shortcut, 0 if none
+    char short_name;
+    // NOTE: FLAG_ENUM only: the accepted strings with their lengths
+    // precomputed at registration, so most candidates are rejected on a
+    // single length comparison
+    const char **choices;
+    size_t *choice_lens;
+    size_t choices_count;
+    // NOTE: bloom signature of the name's bigrams, precomputed at
+    // registration for the did-you-mean shortlist in flag_print_error()
+    uint64_t bigrams;
+    // NOTE: FLAG_CUSTOM only
+    Flag_Custom_Fn custom_fn;
 } Flag;
 
+// NOTE: FLAGS_CAP is only the capacity of the first arena region nowadays.
+// Registration grows the arena as needed, the cap is just a hint for how many
+// flags the program expects.
 #ifndef FLAGS_CAP
 #define FLAGS_CAP 256
 #endif
 
-typedef struct {
-    Flag flags[FLAGS_CAP];
+// NOTE: initial hash table size, twice the first region capacity so the open
+// addressing table starts at most half full
+#define FLAG_HASH_CAP (FLAGS_CAP*2)
+
+typedef struct Flag_Region Flag_Region;
+
+struct Flag_Region {
+    Flag_Region *next;
+    size_t count;
+    size_t capacity;
+    // NOTE: points right past the region header, same allocation
+    Flag *items;
+};
+
+struct Flag_Context {
+    // NOTE: growable arena of registered flags. Regions are never reallocated
+    // or moved, so the pointers returned by flag_bool() and friends stay valid
+    // as the table grows. Each new region doubles the capacity of the
+    // previous one.
+    Flag_Region *regions;
+    Flag_Region *last_region;
     size_t flags_count;
 
+    // NOTE: open addressing index over the registered flags, NULL means the
+    // slot is empty. Grows by rehashing once it gets half full. Everything is
+    // allocated lazily, so a zero-initialized context just works.
+    Flag **hash_table;
+    // NOTE: the probed name hashes live in their own parallel array, so the
+    // probe loop streams over packed uint64s and only dereferences a Flag once
+    // its hash already matched
+    uint64_t *hash_hashes;
+    size_t hash_cap;
+
+    // NOTE: flag pointers sorted by name, maintained on registration, so
+    // GNU-style abbreviations (-cou for -count) resolve with one binary
+    // search instead of strncmp over every registered name
+    Flag **sorted;
+    size_t sorted_cap;
+
+    // NOTE: flattened argv after @response-file expansion. Kept in the context
+    // because rest_argv may point into it after flag_parse() returns.
+    Flag_Tokens response_tokens;
+
+    // NOTE: token pointers built by flag_parse_buf(). Kept in the context for
+    // the same reason as response_tokens and reused across calls.
+    Flag_Tokens buf_tokens;
+
+    // NOTE: lazily rendered cache of the options help, so repeated -help
+    // scrapes cost one fwrite instead of hundreds of formatted stdio calls.
+    // Invalidated whenever another flag gets registered.
+    Flag_String_Builder options_help;
+    bool options_help_valid;
+
+    // NOTE: direct index over single-char shortcuts: one memory load per
+    // character, no hashing and no strcmp at all
+    Flag *short_table[256];
+
+    // NOTE: registered subcommands and the one flag_parse() dispatched to
+    Flag_Subcommand *subcommands;
+    size_t subcommands_count;
+    size_t subcommands_capacity;
+    char *active_subcommand;
+
+    // NOTE: bit per registered flag (indexed by Flag.id), set when a value for
+    // it is actually bound, so "explicitly set vs left at default" is one bit
+    // test instead of sentinel-default tricks
+    uint64_t *provided;
+    size_t provided_cap;   // in 64-bit words
+
+    Flag_Stats stats;
+
+    // NOTE: see flag_permute()
+    bool permute;
+
     Flag_Error flag_error;
     char *flag_error_name;
+    // NOTE: index of the offending token in the (response-file-expanded)
+    // argv, counting argv[0], so callers can point at where parsing stopped
+    int flag_error_argv_index;
 
     int rest_argc;
     char **rest_argv;
-} Flag_Context;
+};
 
-static Flag_Context flag_global_context;
+char *flag_name(void *val);
+bool *flag_bool(const char *name, bool def, const char *desc);
+uint64_t *flag_uint64(const char *name, uint64_t def, const char *desc);
+char **flag_str(const char *name, const char *def, const char *desc);
+int64_t *flag_int64(const char *name, int64_t def, const char *desc);
+double *flag_double(const char *name, double def, const char *desc);
+// NOTE: a byte size: plain number of bytes, optionally with a K, M or G
+// suffix (powers of 1024), e.g. 4K, 16M, 2G
+uint64_t *flag_size(const char *name, uint64_t def, const char *desc);
+// NOTE: collects every occurrence of -name instead of overwriting, e.g.
+// -I dir1 -I dir2 yields a list of two items
+Flag_List *flag_str_list(const char *name, const char *desc);
+// NOTE: collects repeated -name key=value occurrences into a hash table, e.g.
+// -D arch=x86_64 -D os=linux. A bare key without '=' maps to "". Look entries
+// up with flag_kv_get().
+Flag_KV *flag_kv(const char *name, const char *desc);
+char *flag_kv_get(Flag_KV *kv, const char *key);
+// NOTE: accepts exactly one of the given strings and resolves it to its index
+// in choices at parse time, so the application branches on an int instead of
+// strcmp'ing. def is an index into choices.
+int *flag_enum(const char *name, const char **choices, size_t choices_count, int def, const char *desc);
+// NOTE: a duration in nanoseconds, written like 250ms, 1.5s or 90m with the
+// units ns/us/ms/s/m/h. A bare number means nanoseconds, the same way a bare
+// FLAG_SIZE means bytes. def is in nanoseconds.
+uint64_t *flag_duration(const char *name, uint64_t def, const char *desc);
+// NOTE: structured values (host:port pairs, CIDR ranges, ...) decoded by a
+// user callback right inside the parse loop, straight into target, so there
+// is no post-parse second pass over the raw string. parse_fn returning false
+// reports FLAG_ERROR_INVALID_VALUE like a bad enum choice.
+void flag_custom(const char *name, Flag_Custom_Fn parse_fn, void *target, const char *desc);
+// NOTE: gives the flag behind val (a pointer returned by flag_bool() etc, or
+// *_var storage) a single-char shortcut, so -c works next to -count and
+// boolean shortcuts combine into clusters like -abc
+void flag_alias(void *val, char short_name);
+// NOTE: *_var variants that parse straight into user-owned storage, so all
+// flag values can live in one cache-friendly config struct. flag_name() works
+// on such pointers too.
+void flag_bool_var(bool *var, const char *name, bool def, const char *desc);
+void flag_uint64_var(uint64_t *var, const char *name, uint64_t def, const char *desc);
+void flag_str_var(char **var, const char *name, const char *def, const char *desc);
+void flag_int64_var(int64_t *var, const char *name, int64_t def, const char *desc);
+void flag_double_var(double *var, const char *name, double def, const char *desc);
+void flag_size_var(uint64_t *var, const char *name, uint64_t def, const char *desc);
+void flag_duration_var(uint64_t *var, const char *name, uint64_t def, const char *desc);
+// NOTE: git-style subcommands. The registration callback runs lazily, only
+// after flag_parse() identifies the active subcommand from the first
+// positional token, so registration and matching cost scale with one
+// subcommand instead of the union of all of them. Tokens after the subcommand
+// are parsed against the flags its callback registered.
+void flag_subcommand(const char *name, Flag_Subcommand_Fn register_fn, const char *desc);
+// NOTE: name of the subcommand flag_parse() dispatched to, NULL if none
+char *flag_subcommand_name(void);
+void flag_print_subcommands(FILE *stream);
+// NOTE: emits a static completion script for the registered flags and
+// subcommands, so a tab press resolves entirely inside the shell instead of
+// spawning the tool and scraping -help. Meant to run once at install time,
+// e.g. `tool -completion bash > /etc/bash_completion.d/tool`. shell is "bash"
+// or "zsh"; anything else returns false. program is the command name the
+// completion attaches to.
+bool flag_print_completion(FILE *stream, const char *shell, const char *program);
+bool flag_parse(int argc, char **argv);
+// NOTE: opt-in GNU-style permutation: flag_parse() normally stops at the first
+// non-dash token, but with permutation enabled it keeps going, rotating
+// operands behind the unparsed tail with pointer swaps only, so
+// `prog file.txt -count 5` parses -count and flag_rest_argv() still gets a
+// contiguous [file.txt] in the original order. Note that this reorders the
+// caller's argv in place.
+void flag_permute(bool enable);
+// NOTE: parses flags straight out of a raw command buffer (no program name in
+// front), tokenizing it in place: whitespace splits tokens, single and double
+// quotes group and get stripped. String values alias the buffer zero-copy just
+// like they alias argv in flag_parse(), so the buffer must stay alive and
+// writable. On success *consumed (may be NULL) receives how many bytes of the
+// buffer were eaten before the flags stopped.
+bool flag_parse_buf(char *buf, size_t len, size_t *consumed);
+// NOTE: resolves flags from environment variables: one pass over environ
+// binding every PREFIX_FLAG_NAME entry (uppercased, '-' mapped to '_') to the
+// flag it backs. Call it before flag_parse() to get the
+// default < environment < argv precedence without any re-parsing.
+bool flag_parse_env(const char *prefix);
+// NOTE: snapshot of all parsed flag values as a compact binary blob, so
+// forked/re-exec'd workers can restore the parent's configuration at
+// memcpy cost instead of re-parsing argv. Call with buf == NULL to query the
+// required size; returns the number of bytes the snapshot needs. Restoring
+// requires the same flags registered in the same order (i.e. the same
+// binary), string values end up aliasing buf, which must stay alive, and the
+// encoding is native-endian — pass it over a pipe or shared memory, don't
+// put it on disk between machines.
+size_t flag_serialize(void *buf, size_t cap);
+bool flag_deserialize(void *buf, size_t len);
+int flag_rest_argc(void);
+char **flag_rest_argv(void);
+const Flag_Stats *flag_stats(void);
+// NOTE: whether the flag behind val was explicitly set by flag_parse() or
+// flag_parse_env(), as opposed to merely keeping its default
+bool flag_provided(void *val);
+void flag_print_error(FILE *stream);
+// NOTE: the parse failure as plain data, so request-loop daemons can build
+// their own responses without touching stdio on the hot path.
+// flag_print_error() remains the convenience wrapper over these.
+Flag_Error flag_error(void);
+char *flag_error_name(void);
+int flag_error_argv_index(void);
+void flag_print_options(FILE *stream);
+// NOTE: the same text flag_print_options() writes, as one NUL-terminated
+// cached string (length in *len if len is not NULL), so callers can compose
+// usage output with a single write of their own
+const char *flag_options_help(size_t *len);
 
-Flag *flag_new(Flag_Type type, const char *name, const char *desc)
+// NOTE: _c variants of the above that operate on an explicitly provided
+// Flag_Context instead of the global one, so independent command tables can be
+// parsed concurrently from several threads (one context per thread, no
+// locking). A zero-initialized Flag_Context is a valid empty context.
+Flag *flag_new_c(Flag_Context *c, Flag_Type type, const char *name, const char *desc);
+char *flag_name_c(Flag_Context *c, void *val);
+bool *flag_bool_c(Flag_Context *c, const char *name, bool def, const char *desc);
+uint64_t *flag_uint64_c(Flag_Context *c, const char *name, uint64_t def, const char *desc);
+char **flag_str_c(Flag_Context *c, const char *name, const char *def, const char *desc);
+int64_t *flag_int64_c(Flag_Context *c, const char *name, int64_t def, const char *desc);
+double *flag_double_c(Flag_Context *c, const char *name, double def, const char *desc);
+uint64_t *flag_size_c(Flag_Context *c, const char *name, uint64_t def, const char *desc);
+Flag_List *flag_str_list_c(Flag_Context *c, const char *name, const char *desc);
+Flag_KV *flag_kv_c(Flag_Context *c, const char *name, const char *desc);
+int *flag_enum_c(Flag_Context *c, const char *name, const char **choices, size_t choices_count, int def, const char *desc);
+uint64_t *flag_duration_c(Flag_Context *c, const char *name, uint64_t def, const char *desc);
+void flag_custom_c(Flag_Context *c, const char *name, Flag_Custom_Fn parse_fn, void *target, const char *desc);
+void flag_alias_c(Flag_Context *c, void *val, char short_name);
+void flag_bool_var_c(Flag_Context *c, bool *var, const char *name, bool def, const char *desc);
+void flag_uint64_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc);
+void flag_str_var_c(Flag_Context *c, char **var, const char *name, const char *def, const char *desc);
+void flag_int64_var_c(Flag_Context *c, int64_t *var, const char *name, int64_t def, const char *desc);
+void flag_double_var_c(Flag_Context *c, double *var, const char *name, double def, const char *desc);
+void flag_size_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc);
+void flag_duration_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc);
+void flag_subcommand_c(Flag_Context *c, const char *name, Flag_Subcommand_Fn register_fn, const char *desc);
+char *flag_subcommand_name_c(Flag_Context *c);
+void flag_print_subcommands_c(Flag_Context *c, FILE *stream);
+bool flag_print_completion_c(Flag_Context *c, FILE *stream, const char *shell, const char *program);
+bool flag_parse_c(Flag_Context *c, int argc, char **argv);
+void flag_permute_c(Flag_Context *c, bool enable);
+bool flag_parse_buf_c(Flag_Context *c, char *buf, size_t len, size_t *consumed);
+bool flag_parse_env_c(Flag_Context *c, const char *prefix);
+size_t flag_serialize_c(Flag_Context *c, void *buf, size_t cap);
+bool flag_deserialize_c(Flag_Context *c, void *buf, size_t len);
+int flag_rest_argc_c(Flag_Context *c);
+char **flag_rest_argv_c(Flag_Context *c);
+const Flag_Stats *flag_stats_c(Flag_Context *c);
+bool flag_provided_c(Flag_Context *c, void *val);
+void flag_print_error_c(Flag_Context *c, FILE *stream);
+Flag_Error flag_error_c(Flag_Context *c);
+char *flag_error_name_c(Flag_Context *c);
+int flag_error_argv_index_c(Flag_Context *c);
+void flag_print_options_c(Flag_Context *c, FILE *stream);
+const char *flag_options_help_c(Flag_Context *c, size_t *len);
+
+#ifdef __cplusplus
+// NOTE: C++17-only compile-time registration layer. A flag table built from
+// flag_def_*() makers is a constexpr array living in .rodata — names, types,
+// defaults, name lengths and FNV-1a hashes are all assembled by the compiler —
+// and flag_register_table() installs it without doing any strlen or hashing at
+// startup, writing parsed values into the user storage each def points at:
+//
+//     static Config conf;
+//     static constexpr Flag_Def flag_table[] = {
+//         flag_def_bool(&conf.help, "help", false, "Print this help"),
+//         flag_def_uint64(&conf.count, "count", 64, "Amount of lines"),
+//     };
+//     ...
+//     flag_register_table(flag_table);
+//
+struct Flag_Def {
+    Flag_Type type;
+    const char *name;
+    size_t name_len;
+    uint64_t name_hash;
+    const char *desc;
+    // NOTE: typed defaults instead of Flag_Value: C++17 constexpr cannot
+    // activate a union member other than the first one
+    bool def_bool;
+    uint64_t def_uint64;
+    int64_t def_int64;
+    double def_double;
+    const char *def_str;
+    void *var;
+};
+
+constexpr size_t flag_const_len(const char *s)
 {
-    Flag_Context *c = &flag_global_context;
+    size_t n = 0;
+    while (s[n] != '\0') n += 1;
+    return n;
+}
 
-    assert(c->flags_count < FLAGS_CAP);
-    Flag *flag = &c->flags[c->flags_count++];
-    memset(flag, 0, sizeof(*flag));
-    flag->type = type;
-    // NOTE: I won't touch them I promise Kappa
-    flag->name = (char*) name;
-    flag->desc = (char*) desc;
-    return flag;
+// NOTE: must mirror flag_hash_name() in the implementation below
+constexpr uint64_t flag_const_hash(const char *s)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; s[i] != '\0'; ++i) {
+        hash ^= (uint64_t) (unsigned char) s[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
 }
 
-char *flag_name(void *val)
+constexpr Flag_Def flag_def_common(Flag_Type type, void *var, const char *name, const char *desc)
 {
-    Flag *flag = (Flag*) ((char*) val - offsetof(Flag, val));
-    return flag->name;
+    Flag_Def def = {};
+    def.type = type;
+    def.name = name;
+    def.name_len = flag_const_len(name);
+    def.name_hash = flag_const_hash(name);
+    def.desc = desc;
+    def.var = var;
+    return def;
 }
 
-bool *flag_bool(const char *name, bool def, const char *desc)
+constexpr Flag_Def flag_def_bool(bool *var, const char *name, bool def_value, const char *desc)
 {
-    Flag *flag = flag_new(FLAG_BOOL, name, desc);
-    flag->def.as_bool = def;
-    flag->val.as_bool = def;
-    return &flag->val.as_bool;
+    Flag_Def def = flag_def_common(FLAG_BOOL, var, name, desc);
+    def.def_bool = def_value;
+    return def;
 }
 
-uint64_t *flag_uint64(const char *name, uint64_t def, const char *desc)
+constexpr Flag_Def flag_def_uint64(uint64_t *var, const char *name, uint64_t def_value, const char *desc)
 {
-    Flag *flag = flag_new(FLAG_UINT64, name, desc);
-    flag->val.as_uint64 = def;
-    flag->def.as_uint64 = def;
-    return &flag->val.as_uint64;
+    Flag_Def def = flag_def_common(FLAG_UINT64, var, name, desc);
+    def.def_uint64 = def_value;
+    return def;
 }
 
-char **flag_str(const char *name, const char *def, const char *desc)
+constexpr Flag_Def flag_def_str(char **var, const char *name, const char *def_value, const char *desc)
 {
-    Flag *flag = flag_new(FLAG_STR, name, desc);
-    flag->val.as_str = (char*) def;
-    flag->def.as_str = (char*) def;
-    return &flag->val.as_str;
+    Flag_Def def = flag_def_common(FLAG_STR, var, name, desc);
+    def.def_str = def_value;
+    return def;
 }
 
-static char *flag_shift_args(int *argc, char ***argv)
+constexpr Flag_Def flag_def_int64(int64_t *var, const char *name, int64_t def_value, const char *desc)
 {
-    assert(*argc > 0);
-    char *result = **argv;
-    *argv += 1;
-    *argc -= 1;
-    return result;
+    Flag_Def def = flag_def_common(FLAG_INT64, var, name, desc);
+    def.def_int64 = def_value;
+    return def;
 }
 
-int flag_rest_argc(void)
+constexpr Flag_Def flag_def_double(double *var, const char *name, double def_value, const char *desc)
 {
-    return flag_global_context.rest_argc;
+    Flag_Def def = flag_def_common(FLAG_DOUBLE, var, name, desc);
+    def.def_double = def_value;
+    return def;
 }
 
-char **flag_rest_argv(void)
+constexpr Flag_Def flag_def_size(uint64_t *var, const char *name, uint64_t def_value, const char *desc)
 {
-    return flag_global_context.rest_argv;
+    Flag_Def def = flag_def_common(FLAG_SIZE, var, name, desc);
+    def.def_uint64 = def_value;
+    return def;
 }
 
-bool flag_parse(int argc, char **argv)
+void flag_register_defs_c(Flag_Context *c, const Flag_Def *defs, size_t defs_count);
+void flag_register_defs(const Flag_Def *defs, size_t defs_count);
+
+template <size_t N>
+inline void flag_register_table_c(Flag_Context *c, const Flag_Def (&defs)[N])
 {
-    Flag_Context *c = &flag_global_context;
+    flag_register_defs_c(c, defs, N);
+}
 
-    flag_shift_args(&argc, &argv);
+template <size_t N>
+inline void flag_register_table(const Flag_Def (&defs)[N])
+{
+    flag_register_defs(defs, N);
+}
+#endif // __cplusplus
 
-    while (argc > 0) {
-        char *flag = flag_shift_args(&argc, &argv);
+#endif // FLAG_H_
 
-        if (*flag != '-') {
-            // NOTE: pushing flag back into args
-            c->rest_argc = argc + 1;
-            c->rest_argv = argv - 1;
-            return true;
+//////////////////////////////
+
+#ifdef FLAG_IMPLEMENTATION
+
+// NOTE: @response-file expansion is implemented on top of mmap(2)
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// NOTE: big @response-files get tokenized on a few C11 threads when they are
+// available; everything falls back to the single-threaded scan otherwise
+#if !defined(__cplusplus) && !defined(__STDC_NO_THREADS__)
+#define FLAG_HAS_THREADS
+#include <threads.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" char **environ;
+#else
+extern char **environ;
+#endif
+
+// NOTE: counters compile to nothing unless FLAG_STATS is defined
+#ifdef FLAG_STATS
+#include <time.h>
+#define FLAG_STAT_INC(c, field) ((c)->stats.field += 1)
+#else
+#define FLAG_STAT_INC(c, field) ((void) 0)
+#endif
+
+static Flag_Context flag_global_context;
+
+static uint64_t flag_hash_name(const char *name, size_t len)
+{
+    // NOTE: FNV-1a
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint64_t) (unsigned char) name[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static void flag_hash_insert(Flag **hash_table, uint64_t *hash_hashes, size_t hash_cap, Flag *flag)
+{
+    size_t slot = (size_t) (flag->name_hash % hash_cap);
+    while (hash_table[slot] != NULL) {
+        slot = (slot + 1) % hash_cap;
+    }
+    hash_table[slot] = flag;
+    hash_hashes[slot] = flag->name_hash;
+}
+
+static void flag_hash_grow(Flag_Context *c)
+{
+    // NOTE: keep the table at most half full so probe chains stay short
+    if (c->hash_table != NULL && (c->flags_count + 1)*2 <= c->hash_cap) return;
+
+    size_t new_cap = c->hash_table == NULL ? FLAG_HASH_CAP : c->hash_cap*2;
+    Flag **new_table = (Flag**) calloc(new_cap, sizeof(Flag*));
+    assert(new_table != NULL && "out of memory");
+    uint64_t *new_hashes = (uint64_t*) calloc(new_cap, sizeof(uint64_t));
+    assert(new_hashes != NULL && "out of memory");
+
+    for (Flag_Region *region = c->regions; region != NULL; region = region->next) {
+        for (size_t i = 0; i < region->count; ++i) {
+            flag_hash_insert(new_table, new_hashes, new_cap, &region->items[i]);
         }
+    }
 
-        if (strcmp(flag, "--") == 0) {
-            // NOTE: but if it's the terminator we don't need to push it back
-            c->rest_argc = argc;
-            c->rest_argv = argv;
-            return true;
+    free(c->hash_table);
+    free(c->hash_hashes);
+    c->hash_table = new_table;
+    c->hash_hashes = new_hashes;
+    c->hash_cap = new_cap;
+}
+
+// NOTE: 64-bit bloom signature over the name's bigrams, with ^ and $ boundary
+// pairs so even single-char names set a couple of bits. Two names that look
+// alike share most of their bigrams, so the did-you-mean scan can reject
+// unrelated candidates with one AND and a popcount instead of an edit
+// distance each.
+static uint64_t flag_bigram_signature(const char *name, size_t len)
+{
+    uint64_t sig = 0;
+    unsigned prev = '^';
+    for (size_t i = 0; i <= len; ++i) {
+        unsigned x = i < len ? (unsigned char) name[i] : '$';
+        sig |= 1ULL << ((prev*31 + x) % 64);
+        prev = x;
+    }
+    return sig;
+}
+
+static int flag_popcount64(uint64_t x)
+{
+    // NOTE: plain SWAR popcount, no compiler builtins
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int) ((x*0x0101010101010101ULL) >> 56);
+}
+
+static Flag *flag_new_precomputed(Flag_Context *c, Flag_Type type, const char *name, size_t name_len, uint64_t name_hash, const char *desc)
+{
+    Flag_Region *region = c->last_region;
+    if (region == NULL || region->count >= region->capacity) {
+        size_t capacity = region == NULL ? FLAGS_CAP : region->capacity*2;
+        Flag_Region *new_region = (Flag_Region*) malloc(sizeof(Flag_Region) + capacity*sizeof(Flag));
+        assert(new_region != NULL && "out of memory");
+        new_region->next = NULL;
+        new_region->count = 0;
+        new_region->capacity = capacity;
+        new_region->items = (Flag*) (new_region + 1);
+        if (region != NULL) {
+            region->next = new_region;
+        } else {
+            c->regions = new_region;
         }
+        c->last_region = new_region;
+        region = new_region;
+    }
 
-        // NOTE: remove the dash
-        flag += 1;
+    // NOTE: grow the index before appending, so the rehash does not see the
+    // half-initialized flag
+    flag_hash_grow(c);
 
-        bool found = false;
-        for (size_t i = 0; i < c->flags_count; ++i) {
-            if (strcmp(c->flags[i].name, flag) == 0) {
-                switch (c->flags[i].type) {
-                case FLAG_BOOL: {
-                    c->flags[i].val.as_bool = true;
-                }
-                break;
+#ifndef NDEBUG
+    // NOTE: two modules registering the same name is a bug that used to
+    // manifest as one flag silently shadowing the other. The hash index makes
+    // the check a single probe at registration; NDEBUG builds skip it
+    // entirely.
+    for (size_t slot = (size_t) (name_hash % c->hash_cap);
+         c->hash_table[slot] != NULL;
+         slot = (slot + 1) % c->hash_cap) {
+        Flag *other = c->hash_table[slot];
+        if (other->name_hash == name_hash &&
+            other->name_len == name_len &&
+            memcmp(other->name, name, name_len) == 0) {
+            assert(0 && "flag with this name is already registered");
+        }
+    }
+#endif // NDEBUG
 
-                case FLAG_STR: {
-                    if (argc == 0) {
-                        c->flag_error = FLAG_ERROR_NO_VALUE;
-                        c->flag_error_name = flag;
-                        return false;
-                    }
-                    char *arg = flag_shift_args(&argc, &argv);
-                    c->flags[i].val.as_str = arg;
-                }
-                break;
+    size_t words = c->flags_count/64 + 1;
+    if (words > c->provided_cap) {
+        size_t new_cap = c->provided_cap == 0 ? 4 : c->provided_cap;
+        while (new_cap < words) new_cap *= 2;
+        c->provided = (uint64_t*) realloc(c->provided, new_cap*sizeof(uint64_t));
+        assert(c->provided != NULL && "out of memory");
+        memset(c->provided + c->provided_cap, 0, (new_cap - c->provided_cap)*sizeof(uint64_t));
+        c->provided_cap = new_cap;
+    }
 
-                case FLAG_UINT64: {
-                    if (argc == 0) {
-                        c->flag_error = FLAG_ERROR_NO_VALUE;
-                        c->flag_error_name = flag;
-                        return false;
-                    }
-                    char *arg = flag_shift_args(&argc, &argv);
-
-                    static_assert(sizeof(unsigned long long int) == sizeof(uint64_t), "The original author designed this for x86_64 machine with the compiler that expects unsigned long long int and uint64_t to be the same thing, so they could use strtoull() function to parse it. Please adjust this code for your case and maybe even send the patch to upstream to make it work on a wider range of environments.");
-                    char *endptr;
-                    // TODO: replace strtoull with a custom solution
-                    // That way we can get rid of the dependency on errno and static_assert
-                    unsigned long long int result = strtoull(arg, &endptr, 10);
-
-                    if (arg == endptr || *endptr != '\0') {
-                        c->flag_error = FLAG_ERROR_INVALID_NUMBER;
-                        c->flag_error_name = flag;
-                        return false;
-                    }
-                    if (result == ULLONG_MAX && errno == ERANGE) {
-                        c->flag_error = FLAG_ERROR_INTEGER_OVERFLOW;
-                        c->flag_error_name = flag;
-                        return false;
-                    }
+    Flag *flag = &region->items[region->count++];
+    memset(flag, 0, sizeof(*flag));
+    flag->id = c->flags_count;
+    c->flags_count += 1;
+    flag->type = type;
+    // NOTE: I won't touch them I promise Kappa
+    flag->name = (char*) name;
+    flag->desc = (char*) desc;
+    flag->name_len = name_len;
+    flag->name_hash = name_hash;
+    flag->bigrams = flag_bigram_signature(name, name_len);
+    flag->var = &flag->val;
 
-                    c->flags[i].val.as_uint64 = result;
-                }
-                break;
+    c->options_help_valid = false;
 
-                default: {
-                    assert(0 && "unreachable");
-                    exit(69);
-                }
-                }
+    flag_hash_insert(c->hash_table, c->hash_hashes, c->hash_cap, flag);
+
+    // NOTE: registration is rare and front-loaded, so a sorted insert with a
+    // memmove beats maintaining an actual trie here
+    if (c->flags_count > c->sorted_cap) {
+        size_t new_cap = c->sorted_cap == 0 ? FLAGS_CAP : c->sorted_cap*2;
+        c->sorted = (Flag**) realloc(c->sorted, new_cap*sizeof(Flag*));
+        assert(c->sorted != NULL && "out of memory");
+        c->sorted_cap = new_cap;
+    }
+    size_t pos = 0;
+    while (pos + 1 < c->flags_count && strcmp(c->sorted[pos]->name, flag->name) < 0) pos += 1;
+    memmove(&c->sorted[pos + 1], &c->sorted[pos], (c->flags_count - 1 - pos)*sizeof(Flag*));
+    c->sorted[pos] = flag;
+
+    return flag;
+}
 
-                found = true;
+Flag *flag_new_c(Flag_Context *c, Flag_Type type, const char *name, const char *desc)
+{
+    size_t name_len = strlen(name);
+    return flag_new_precomputed(c, type, name, name_len, flag_hash_name(name, name_len), desc);
+}
+
+static Flag *flag_lookup(Flag_Context *c, const char *name, size_t name_len)
+{
+    if (c->hash_table == NULL) return NULL;
+
+    uint64_t hash = flag_hash_name(name, name_len);
+    size_t slot = (size_t) (hash % c->hash_cap);
+    while (c->hash_table[slot] != NULL) {
+        FLAG_STAT_INC(c, name_comparisons);
+        // NOTE: probe over the packed hash array; the 40-byte Flag (with its
+        // desc and default the comparison never reads) is only pulled into
+        // cache on a hash hit
+        if (c->hash_hashes[slot] == hash) {
+            Flag *flag = c->hash_table[slot];
+            if (flag->name_len == name_len && memcmp(flag->name, name, name_len) == 0) {
+                return flag;
             }
         }
+        slot = (slot + 1) % c->hash_cap;
+    }
+    return NULL;
+}
 
-        if (!found) {
-            c->flag_error = FLAG_ERROR_UNKNOWN;
-            c->flag_error_name = flag;
-            return false;
+Flag *flag_new(Flag_Type type, const char *name, const char *desc)
+{
+    return flag_new_c(&flag_global_context, type, name, desc);
+}
+
+// NOTE: resolves a GNU-style abbreviation: binary searches the sorted name
+// array for the first flag whose name is not below `name`, then checks whether
+// it actually starts with it. A second flag sharing the prefix makes the
+// abbreviation ambiguous, reported through *ambiguous so the caller can tell
+// that apart from an unknown flag.
+static Flag *flag_lookup_prefix(Flag_Context *c, const char *name, size_t name_len, bool *ambiguous)
+{
+    // NOTE: an empty prefix would "abbreviate" every registered name
+    if (name_len == 0) return NULL;
+
+    size_t lo = 0;
+    size_t hi = c->flags_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        Flag *it = c->sorted[mid];
+        FLAG_STAT_INC(c, name_comparisons);
+        size_t n = it->name_len < name_len ? it->name_len : name_len;
+        int order = memcmp(it->name, name, n);
+        if (order == 0 && it->name_len < name_len) order = -1;
+        if (order < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    if (lo >= c->flags_count) return NULL;
+    Flag *it = c->sorted[lo];
+    if (it->name_len < name_len || memcmp(it->name, name, name_len) != 0) return NULL;
+
+    if (lo + 1 < c->flags_count) {
+        Flag *next = c->sorted[lo + 1];
+        if (next->name_len >= name_len && memcmp(next->name, name, name_len) == 0) {
+            *ambiguous = true;
+            return NULL;
         }
     }
 
-    c->rest_argc = argc;
-    c->rest_argv = argv;
-    return true;
+    return it;
 }
 
-void flag_print_options(FILE *stream)
+// NOTE: *_var flags point at arbitrary user storage, so the old
+// offsetof(Flag, val) trick is no longer sound. This is only used on cold
+// paths, a linear scan over the destinations is fine here.
+static Flag *flag_find_var(Flag_Context *c, void *val)
 {
-    Flag_Context *c = &flag_global_context;
-    for (size_t i = 0; i < c->flags_count; ++i) {
-        Flag *flag = &c->flags[i];
-
-        fprintf(stream, "    -%s\n", flag->name);
-        fprintf(stream, "        %s\n", flag->desc);
-        switch (c->flags[i].type) {
-        case FLAG_BOOL:
-            if (flag->def.as_bool) {
-                fprintf(stream, "        Default: %s\n", flag->def.as_bool ? "true" : "false");
-            }
-            break;
-        case FLAG_UINT64:
-            fprintf(stream, "        Default: %" PRIu64 "\n", flag->def.as_uint64);
-            break;
-        case FLAG_STR:
-            if (flag->def.as_str) {
-                fprintf(stream, "        Default: %s\n", flag->def.as_str);
+    for (Flag_Region *region = c->regions; region != NULL; region = region->next) {
+        for (size_t i = 0; i < region->count; ++i) {
+            if (region->items[i].var == val) {
+                return &region->items[i];
             }
-            break;
-        default:
-            assert(0 && "unreachable");
-            exit(69);
         }
     }
+    return NULL;
 }
 
-void flag_print_error(FILE *stream)
+char *flag_name_c(Flag_Context *c, void *val)
 {
-    Flag_Context *c = &flag_global_context;
-    switch (c->flag_error) {
-    case FLAG_NO_ERROR:
-        // NOTE: don't call flag_print_error() if flag_parse() didn't return false, okay? ._.
-        fprintf(stream, "Operation Failed Successfully! Please tell the developer of this software that they don't know what they are doing! :)");
-        break;
-    case FLAG_ERROR_UNKNOWN:
-        fprintf(stream, "ERROR: -%s: unknown flag\n", c->flag_error_name);
-        break;
-    case FLAG_ERROR_NO_VALUE:
-        fprintf(stream, "ERROR: -%s: no value provided\n", c->flag_error_name);
-        break;
-    case FLAG_ERROR_INVALID_NUMBER:
-        fprintf(stream, "ERROR: -%s: invalid number\n", c->flag_error_name);
-        break;
-    case FLAG_ERROR_INTEGER_OVERFLOW:
-        fprintf(stream, "ERROR: -%s: integer overflow\n", c->flag_error_name);
-        break;
-    default:
-        assert(0 && "unreachable");
-        exit(69);
-    }
+    Flag *flag = flag_find_var(c, val);
+    return flag == NULL ? NULL : flag->name;
+}
+
+char *flag_name(void *val)
+{
+    return flag_name_c(&flag_global_context, val);
+}
+
+bool *flag_bool_c(Flag_Context *c, const char *name, bool def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_BOOL, name, desc);
+    flag->def.as_bool = def;
+    flag->val.as_bool = def;
+    return &flag->val.as_bool;
+}
+
+bool *flag_bool(const char *name, bool def, const char *desc)
+{
+    return flag_bool_c(&flag_global_context, name, def, desc);
+}
+
+uint64_t *flag_uint64_c(Flag_Context *c, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_UINT64, name, desc);
+    flag->val.as_uint64 = def;
+    flag->def.as_uint64 = def;
+    return &flag->val.as_uint64;
+}
+
+uint64_t *flag_uint64(const char *name, uint64_t def, const char *desc)
+{
+    return flag_uint64_c(&flag_global_context, name, def, desc);
+}
+
+char **flag_str_c(Flag_Context *c, const char *name, const char *def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_STR, name, desc);
+    flag->val.as_str = (char*) def;
+    flag->def.as_str = (char*) def;
+    return &flag->val.as_str;
+}
+
+char **flag_str(const char *name, const char *def, const char *desc)
+{
+    return flag_str_c(&flag_global_context, name, def, desc);
+}
+
+int64_t *flag_int64_c(Flag_Context *c, const char *name, int64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_INT64, name, desc);
+    flag->val.as_int64 = def;
+    flag->def.as_int64 = def;
+    return &flag->val.as_int64;
+}
+
+int64_t *flag_int64(const char *name, int64_t def, const char *desc)
+{
+    return flag_int64_c(&flag_global_context, name, def, desc);
+}
+
+double *flag_double_c(Flag_Context *c, const char *name, double def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_DOUBLE, name, desc);
+    flag->val.as_double = def;
+    flag->def.as_double = def;
+    return &flag->val.as_double;
+}
+
+double *flag_double(const char *name, double def, const char *desc)
+{
+    return flag_double_c(&flag_global_context, name, def, desc);
+}
+
+uint64_t *flag_size_c(Flag_Context *c, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_SIZE, name, desc);
+    flag->val.as_uint64 = def;
+    flag->def.as_uint64 = def;
+    return &flag->val.as_uint64;
+}
+
+uint64_t *flag_size(const char *name, uint64_t def, const char *desc)
+{
+    return flag_size_c(&flag_global_context, name, def, desc);
+}
+
+uint64_t *flag_duration_c(Flag_Context *c, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_DURATION, name, desc);
+    flag->val.as_uint64 = def;
+    flag->def.as_uint64 = def;
+    return &flag->val.as_uint64;
+}
+
+uint64_t *flag_duration(const char *name, uint64_t def, const char *desc)
+{
+    return flag_duration_c(&flag_global_context, name, def, desc);
+}
+
+void flag_custom_c(Flag_Context *c, const char *name, Flag_Custom_Fn parse_fn, void *target, const char *desc)
+{
+    assert(parse_fn != NULL);
+    assert(target != NULL);
+    Flag *flag = flag_new_c(c, FLAG_CUSTOM, name, desc);
+    flag->custom_fn = parse_fn;
+    flag->var = target;
+}
+
+void flag_custom(const char *name, Flag_Custom_Fn parse_fn, void *target, const char *desc)
+{
+    flag_custom_c(&flag_global_context, name, parse_fn, target, desc);
+}
+
+Flag_List *flag_str_list_c(Flag_Context *c, const char *name, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_STR_LIST, name, desc);
+    return &flag->val.as_list;
+}
+
+Flag_List *flag_str_list(const char *name, const char *desc)
+{
+    return flag_str_list_c(&flag_global_context, name, desc);
+}
+
+Flag_KV *flag_kv_c(Flag_Context *c, const char *name, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_KV, name, desc);
+    return &flag->val.as_kv;
+}
+
+Flag_KV *flag_kv(const char *name, const char *desc)
+{
+    return flag_kv_c(&flag_global_context, name, desc);
+}
+
+int *flag_enum_c(Flag_Context *c, const char *name, const char **choices, size_t choices_count, int def, const char *desc)
+{
+    assert(choices_count > 0);
+    assert(0 <= def && (size_t) def < choices_count);
+    Flag *flag = flag_new_c(c, FLAG_ENUM, name, desc);
+    flag->choices = choices;
+    flag->choice_lens = (size_t*) malloc(choices_count*sizeof(size_t));
+    assert(flag->choice_lens != NULL && "out of memory");
+    for (size_t i = 0; i < choices_count; ++i) {
+        flag->choice_lens[i] = strlen(choices[i]);
+    }
+    flag->choices_count = choices_count;
+    flag->def.as_enum = def;
+    flag->val.as_enum = def;
+    return &flag->val.as_enum;
+}
+
+int *flag_enum(const char *name, const char **choices, size_t choices_count, int def, const char *desc)
+{
+    return flag_enum_c(&flag_global_context, name, choices, choices_count, def, desc);
+}
+
+void flag_alias_c(Flag_Context *c, void *val, char short_name)
+{
+    Flag *flag = flag_find_var(c, val);
+    assert(flag != NULL && "flag_alias() expects a pointer obtained from flag registration");
+    flag->short_name = short_name;
+    c->short_table[(unsigned char) short_name] = flag;
+    c->options_help_valid = false;
+}
+
+void flag_alias(void *val, char short_name)
+{
+    flag_alias_c(&flag_global_context, val, short_name);
+}
+
+void flag_bool_var_c(Flag_Context *c, bool *var, const char *name, bool def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_BOOL, name, desc);
+    flag->def.as_bool = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_bool_var(bool *var, const char *name, bool def, const char *desc)
+{
+    flag_bool_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_uint64_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_UINT64, name, desc);
+    flag->def.as_uint64 = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_uint64_var(uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    flag_uint64_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_str_var_c(Flag_Context *c, char **var, const char *name, const char *def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_STR, name, desc);
+    flag->def.as_str = (char*) def;
+    flag->var = var;
+    *var = (char*) def;
+}
+
+void flag_str_var(char **var, const char *name, const char *def, const char *desc)
+{
+    flag_str_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_int64_var_c(Flag_Context *c, int64_t *var, const char *name, int64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_INT64, name, desc);
+    flag->def.as_int64 = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_int64_var(int64_t *var, const char *name, int64_t def, const char *desc)
+{
+    flag_int64_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_double_var_c(Flag_Context *c, double *var, const char *name, double def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_DOUBLE, name, desc);
+    flag->def.as_double = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_double_var(double *var, const char *name, double def, const char *desc)
+{
+    flag_double_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_size_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_SIZE, name, desc);
+    flag->def.as_uint64 = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_size_var(uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    flag_size_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_duration_var_c(Flag_Context *c, uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    Flag *flag = flag_new_c(c, FLAG_DURATION, name, desc);
+    flag->def.as_uint64 = def;
+    flag->var = var;
+    *var = def;
+}
+
+void flag_duration_var(uint64_t *var, const char *name, uint64_t def, const char *desc)
+{
+    flag_duration_var_c(&flag_global_context, var, name, def, desc);
+}
+
+void flag_subcommand_c(Flag_Context *c, const char *name, Flag_Subcommand_Fn register_fn, const char *desc)
+{
+    if (c->subcommands_count >= c->subcommands_capacity) {
+        c->subcommands_capacity = c->subcommands_capacity == 0 ? 8 : c->subcommands_capacity*2;
+        c->subcommands = (Flag_Subcommand*) realloc(c->subcommands, c->subcommands_capacity*sizeof(Flag_Subcommand));
+        assert(c->subcommands != NULL && "out of memory");
+    }
+    Flag_Subcommand *sub = &c->subcommands[c->subcommands_count++];
+    sub->name = (char*) name;
+    sub->desc = (char*) desc;
+    sub->register_fn = register_fn;
+}
+
+void flag_subcommand(const char *name, Flag_Subcommand_Fn register_fn, const char *desc)
+{
+    flag_subcommand_c(&flag_global_context, name, register_fn, desc);
+}
+
+char *flag_subcommand_name_c(Flag_Context *c)
+{
+    return c->active_subcommand;
+}
+
+char *flag_subcommand_name(void)
+{
+    return flag_subcommand_name_c(&flag_global_context);
+}
+
+static void flag_sb_appendf(Flag_String_Builder *sb, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    assert(n >= 0);
+
+    if (sb->count + (size_t) n + 1 > sb->capacity) {
+        if (sb->capacity == 0) sb->capacity = 1024;
+        while (sb->count + (size_t) n + 1 > sb->capacity) sb->capacity *= 2;
+        sb->items = (char*) realloc(sb->items, sb->capacity);
+        assert(sb->items != NULL && "out of memory");
+    }
+
+    va_start(args, fmt);
+    vsnprintf(sb->items + sb->count, (size_t) n + 1, fmt, args);
+    va_end(args);
+    sb->count += (size_t) n;
+}
+
+static void flag_tokens_append(Flag_Tokens *tokens, char *token)
+{
+    if (tokens->count >= tokens->capacity) {
+        tokens->capacity = tokens->capacity == 0 ? 64 : tokens->capacity*2;
+        tokens->items = (char**) realloc(tokens->items, tokens->capacity*sizeof(char*));
+        assert(tokens->items != NULL && "out of memory");
+    }
+    tokens->items[tokens->count++] = token;
+}
+
+// NOTE: response files refering to each other should not expand forever
+#define FLAG_RESPONSE_DEPTH_MAX 16
+
+// NOTE: response files at least this big get their token discovery split
+// across FLAG_RESPONSE_TOKENIZE_THREADS chunks; below it one chunk is scanned
+// inline and no threads are spawned
+#ifndef FLAG_RESPONSE_PARALLEL_THRESHOLD
+#define FLAG_RESPONSE_PARALLEL_THRESHOLD (1024*1024)
+#endif
+#ifndef FLAG_RESPONSE_TOKENIZE_THREADS
+#define FLAG_RESPONSE_TOKENIZE_THREADS 4
+#endif
+
+typedef struct {
+    char *data;
+    size_t begin;
+    size_t end;
+    size_t file_len;
+    Flag_Tokens tokens;
+} Flag_Tokenize_Chunk;
+
+// NOTE: scans data[begin..end) into chunk->tokens, writing terminators in
+// place. `end` always sits on a whitespace boundary (or the end of the file)
+// and the neighbouring chunk starts one past it, so concurrently scanned
+// chunks never touch the same bytes.
+static void flag_tokenize_chunk(Flag_Tokenize_Chunk *chunk)
+{
+    char *data = chunk->data;
+    size_t i = chunk->begin;
+    while (i < chunk->end) {
+        while (i < chunk->end && isspace((unsigned char) data[i])) i += 1;
+        if (i >= chunk->end) break;
+
+        size_t begin = i;
+        while (i < chunk->end && !isspace((unsigned char) data[i])) i += 1;
+
+        char *token;
+        if (i < chunk->file_len) {
+            data[i] = '\0';
+            i += 1;
+            token = &data[begin];
+        } else {
+            // NOTE: the token runs up to the very end of the file, so there is
+            // no room for the terminator inside the mapping
+            size_t n = i - begin;
+            token = (char*) malloc(n + 1);
+            assert(token != NULL && "out of memory");
+            memcpy(token, &data[begin], n);
+            token[n] = '\0';
+        }
+        flag_tokens_append(&chunk->tokens, token);
+    }
+}
+
+#ifdef FLAG_HAS_THREADS
+static int flag_tokenize_chunk_thrd(void *arg)
+{
+    flag_tokenize_chunk((Flag_Tokenize_Chunk*) arg);
+    return 0;
+}
+#endif // FLAG_HAS_THREADS
+
+// NOTE: memory-map the file at path and split it into whitespace-separated
+// tokens in place. The produced tokens alias the mapping (which is deliberately
+// never unmapped, parsed string values keep pointing into it), so ingesting
+// even a huge response file is one mmap plus one linear pass — no per-line
+// reads and no per-token allocations.
+static bool flag_expand_response_file(Flag_Context *c, char *path, size_t depth)
+{
+    if (depth > FLAG_RESPONSE_DEPTH_MAX) {
+        c->flag_error = FLAG_ERROR_RESPONSE_FILE;
+        c->flag_error_name = path;
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        c->flag_error = FLAG_ERROR_RESPONSE_FILE;
+        c->flag_error_name = path;
+        return false;
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        close(fd);
+        c->flag_error = FLAG_ERROR_RESPONSE_FILE;
+        c->flag_error_name = path;
+        return false;
+    }
+    size_t len = (size_t) statbuf.st_size;
+
+    char *data = NULL;
+    if (len > 0) {
+        // NOTE: MAP_PRIVATE so terminating the tokens in place does not touch
+        // the file itself
+        data = (char*) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            c->flag_error = FLAG_ERROR_RESPONSE_FILE;
+            c->flag_error_name = path;
+            return false;
+        }
+    }
+    close(fd);
+
+    // NOTE: token discovery is embarrassingly parallel, so a big mapping is
+    // split into whitespace-aligned chunks scanned concurrently; only the
+    // merge below, which preserves token order and expands nested @files,
+    // stays sequential
+    Flag_Tokenize_Chunk chunks[FLAG_RESPONSE_TOKENIZE_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    size_t chunks_count = 0;
+#ifdef FLAG_HAS_THREADS
+    size_t want = len >= FLAG_RESPONSE_PARALLEL_THRESHOLD ? FLAG_RESPONSE_TOKENIZE_THREADS : 1;
+#else
+    size_t want = 1;
+#endif
+    size_t begin = 0;
+    for (size_t t = 0; t < want && begin < len; ++t) {
+        size_t end = len*(t + 1)/want;
+        if (end < begin) end = begin;
+        while (end < len && !isspace((unsigned char) data[end])) end += 1;
+        chunks[chunks_count].data = data;
+        chunks[chunks_count].begin = begin;
+        chunks[chunks_count].end = end;
+        chunks[chunks_count].file_len = len;
+        chunks_count += 1;
+        begin = end + 1;
+    }
+
+#ifdef FLAG_HAS_THREADS
+    thrd_t threads[FLAG_RESPONSE_TOKENIZE_THREADS];
+    bool threaded[FLAG_RESPONSE_TOKENIZE_THREADS];
+    memset(threaded, 0, sizeof(threaded));
+    for (size_t t = 1; t < chunks_count; ++t) {
+        // NOTE: thread creation can fail under resource pressure, in which
+        // case the chunk simply gets scanned inline below
+        threaded[t] = thrd_create(&threads[t], flag_tokenize_chunk_thrd, &chunks[t]) == thrd_success;
+    }
+#endif
+    if (chunks_count > 0) flag_tokenize_chunk(&chunks[0]);
+    for (size_t t = 1; t < chunks_count; ++t) {
+#ifdef FLAG_HAS_THREADS
+        if (threaded[t]) {
+            thrd_join(threads[t], NULL);
+            continue;
+        }
+#endif
+        flag_tokenize_chunk(&chunks[t]);
+    }
+
+    for (size_t t = 0; t < chunks_count; ++t) {
+        for (size_t j = 0; j < chunks[t].tokens.count; ++j) {
+            char *token = chunks[t].tokens.items[j];
+            if (token[0] == '@') {
+                if (!flag_expand_response_file(c, token + 1, depth + 1)) return false;
+            } else {
+                flag_tokens_append(&c->response_tokens, token);
+            }
+        }
+        free(chunks[t].tokens.items);
+    }
+
+    return true;
+}
+
+static char *flag_shift_args(int *argc, char ***argv)
+{
+    assert(*argc > 0);
+    char *result = **argv;
+    *argv += 1;
+    *argc -= 1;
+    return result;
+}
+
+// NOTE: locale-free replacement for strtoull() so we don't depend on errno or
+// on unsigned long long int and uint64_t being the same thing. All len bytes
+// must be decimal digits. Returns FLAG_NO_ERROR, FLAG_ERROR_INVALID_NUMBER or
+// FLAG_ERROR_INTEGER_OVERFLOW.
+static Flag_Error flag_parse_uint64(const char *str, size_t len, uint64_t *out)
+{
+    if (len == 0) return FLAG_ERROR_INVALID_NUMBER;
+
+    uint64_t result = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // NOTE: SWAR over 8-byte chunks: validate and convert 8 digits at a time
+    // instead of looping byte by byte
+    while (len >= 8) {
+        uint64_t chunk;
+        memcpy(&chunk, str, 8);
+
+        uint64_t digits = chunk ^ 0x3030303030303030ULL;
+        // NOTE: every byte of `digits` must be <= 9, otherwise some character
+        // was not '0'..'9'
+        if (((digits + 0x7676767676767676ULL) | digits) & 0x8080808080808080ULL) {
+            return FLAG_ERROR_INVALID_NUMBER;
+        }
+
+        // NOTE: fold pairs of digits together: bytes -> hundreds -> ten-thousands -> full value
+        digits = digits*10 + (digits >> 8);
+        digits = (((digits & 0x000000FF000000FFULL) * ((uint64_t) 1000000 << 32 | 100)) +
+                  (((digits >> 16) & 0x000000FF000000FFULL) * ((uint64_t) 10000 << 32 | 1))) >> 32;
+
+        if (result > (UINT64_MAX - digits)/100000000) {
+            return FLAG_ERROR_INTEGER_OVERFLOW;
+        }
+        result = result*100000000 + digits;
+
+        str += 8;
+        len -= 8;
+    }
+#endif // __ORDER_LITTLE_ENDIAN__
+
+    while (len > 0) {
+        uint64_t digit = (uint64_t) (unsigned char) *str - '0';
+        if (digit > 9) {
+            return FLAG_ERROR_INVALID_NUMBER;
+        }
+        if (result > (UINT64_MAX - digit)/10) {
+            return FLAG_ERROR_INTEGER_OVERFLOW;
+        }
+        result = result*10 + digit;
+        str += 1;
+        len -= 1;
+    }
+
+    *out = result;
+    return FLAG_NO_ERROR;
+}
+
+static Flag_Error flag_parse_int64(const char *str, int64_t *out)
+{
+    bool negative = false;
+    if (*str == '-') {
+        negative = true;
+        str += 1;
+    } else if (*str == '+') {
+        str += 1;
+    }
+
+    uint64_t magnitude;
+    Flag_Error error = flag_parse_uint64(str, strlen(str), &magnitude);
+    if (error != FLAG_NO_ERROR) return error;
+
+    if (negative) {
+        if (magnitude > (uint64_t) INT64_MAX + 1) return FLAG_ERROR_INTEGER_OVERFLOW;
+        *out = magnitude == (uint64_t) INT64_MAX + 1 ? INT64_MIN : -(int64_t) magnitude;
+    } else {
+        if (magnitude > (uint64_t) INT64_MAX) return FLAG_ERROR_INTEGER_OVERFLOW;
+        *out = (int64_t) magnitude;
+    }
+    return FLAG_NO_ERROR;
+}
+
+// NOTE: single-pass strtod() replacement in the same spirit as
+// flag_parse_uint64(): locale-free and branch-light. The mantissa accumulates
+// into a uint64 (19 significant digits, the rest only shift the exponent)
+// which is then scaled by binary powers of ten, so the result can be one ulp
+// off the ideal rounding — more than good enough for command-line flags.
+static Flag_Error flag_parse_double(const char *str, double *out)
+{
+    bool negative = false;
+    if (*str == '-') {
+        negative = true;
+        str += 1;
+    } else if (*str == '+') {
+        str += 1;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any_digits = false;
+
+    for (; (uint64_t) (unsigned char) *str - '0' <= 9; ++str) {
+        any_digits = true;
+        if (digits < 19) {
+            mantissa = mantissa*10 + (uint64_t) (*str - '0');
+            digits += 1;
+        } else {
+            exponent += 1;
+        }
+    }
+
+    if (*str == '.') {
+        str += 1;
+        for (; (uint64_t) (unsigned char) *str - '0' <= 9; ++str) {
+            any_digits = true;
+            if (digits < 19) {
+                mantissa = mantissa*10 + (uint64_t) (*str - '0');
+                digits += 1;
+                exponent -= 1;
+            }
+        }
+    }
+
+    if (!any_digits) return FLAG_ERROR_INVALID_NUMBER;
+
+    if (*str == 'e' || *str == 'E') {
+        str += 1;
+        bool exp_negative = false;
+        if (*str == '-') {
+            exp_negative = true;
+            str += 1;
+        } else if (*str == '+') {
+            str += 1;
+        }
+        int exp_value = 0;
+        bool any_exp_digits = false;
+        for (; (uint64_t) (unsigned char) *str - '0' <= 9; ++str) {
+            any_exp_digits = true;
+            if (exp_value < 10000) exp_value = exp_value*10 + (*str - '0');
+        }
+        if (!any_exp_digits) return FLAG_ERROR_INVALID_NUMBER;
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (*str != '\0') return FLAG_ERROR_INVALID_NUMBER;
+
+    static const double flag_powers_of_ten[] = {1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256};
+    int e = exponent < 0 ? -exponent : exponent;
+    if (e > 511) e = 511;
+    double scale = 1.0;
+    for (int bit = 0; bit < 9; ++bit) {
+        if (e & (1 << bit)) scale *= flag_powers_of_ten[bit];
+    }
+
+    double value = exponent < 0 ? (double) mantissa/scale : (double) mantissa*scale;
+    *out = negative ? -value : value;
+    return FLAG_NO_ERROR;
+}
+
+static Flag_Error flag_parse_size(const char *str, uint64_t *out)
+{
+    size_t len = strlen(str);
+    size_t digits_len = 0;
+    while (digits_len < len && (uint64_t) (unsigned char) str[digits_len] - '0' <= 9) {
+        digits_len += 1;
+    }
+
+    uint64_t multiplier = 1;
+    if (digits_len < len) {
+        // NOTE: exactly one of the K/M/G suffixes, powers of 1024
+        if (digits_len + 1 < len) return FLAG_ERROR_INVALID_NUMBER;
+        switch (tolower((unsigned char) str[digits_len])) {
+        case 'k': multiplier = 1024ULL; break;
+        case 'm': multiplier = 1024ULL*1024; break;
+        case 'g': multiplier = 1024ULL*1024*1024; break;
+        default: return FLAG_ERROR_INVALID_NUMBER;
+        }
+    }
+
+    uint64_t result;
+    Flag_Error error = flag_parse_uint64(str, digits_len, &result);
+    if (error != FLAG_NO_ERROR) return error;
+
+    if (result > UINT64_MAX/multiplier) return FLAG_ERROR_INTEGER_OVERFLOW;
+    *out = result*multiplier;
+    return FLAG_NO_ERROR;
+}
+
+// NOTE: parses durations like 250ms, 1.5s or 90m into nanoseconds in a single
+// pass: the integer digits go through the same SWAR path as FLAG_UINT64, the
+// optional fraction is folded digit by digit against the unit, and the unit
+// resolves from its first character and length instead of a strcmp ladder
+// (that pair is unique across ns/us/ms/s/m/h)
+static Flag_Error flag_parse_duration(const char *str, uint64_t *out)
+{
+    size_t len = strlen(str);
+    size_t digits_len = 0;
+    while (digits_len < len && (uint64_t) (unsigned char) str[digits_len] - '0' <= 9) {
+        digits_len += 1;
+    }
+
+    size_t frac_begin = digits_len;
+    size_t frac_len = 0;
+    if (digits_len < len && str[digits_len] == '.') {
+        frac_begin = digits_len + 1;
+        while (frac_begin + frac_len < len && (uint64_t) (unsigned char) str[frac_begin + frac_len] - '0' <= 9) {
+            frac_len += 1;
+        }
+        if (frac_len == 0) return FLAG_ERROR_INVALID_NUMBER;
+    }
+    if (digits_len == 0 && frac_len == 0) return FLAG_ERROR_INVALID_NUMBER;
+
+    uint64_t unit = 1;
+    const char *suffix = str + frac_begin + frac_len;
+    size_t suffix_len = len - (size_t) (suffix - str);
+    if (suffix_len > 0) {
+        switch (suffix[0]) {
+        case 'n': if (suffix_len != 2 || suffix[1] != 's') return FLAG_ERROR_INVALID_NUMBER;
+                  unit = 1; break;
+        case 'u': if (suffix_len != 2 || suffix[1] != 's') return FLAG_ERROR_INVALID_NUMBER;
+                  unit = 1000ULL; break;
+        case 'm': if (suffix_len == 1) unit = 60ULL*1000000000;
+                  else if (suffix_len == 2 && suffix[1] == 's') unit = 1000000ULL;
+                  else return FLAG_ERROR_INVALID_NUMBER;
+                  break;
+        case 's': if (suffix_len != 1) return FLAG_ERROR_INVALID_NUMBER;
+                  unit = 1000000000ULL; break;
+        case 'h': if (suffix_len != 1) return FLAG_ERROR_INVALID_NUMBER;
+                  unit = 3600ULL*1000000000; break;
+        default: return FLAG_ERROR_INVALID_NUMBER;
+        }
+    }
+
+    uint64_t whole = 0;
+    if (digits_len > 0) {
+        Flag_Error error = flag_parse_uint64(str, digits_len, &whole);
+        if (error != FLAG_NO_ERROR) return error;
+    }
+    if (whole > UINT64_MAX/unit) return FLAG_ERROR_INTEGER_OVERFLOW;
+    uint64_t result = whole*unit;
+
+    // NOTE: each fraction digit weighs a tenth of the previous one; the
+    // integer division drops sub-nanosecond precision, which a nanosecond
+    // count cannot carry anyway
+    uint64_t sub = unit;
+    for (size_t i = 0; i < frac_len; ++i) {
+        sub /= 10;
+        uint64_t add = ((uint64_t) (unsigned char) str[frac_begin + i] - '0')*sub;
+        if (result > UINT64_MAX - add) return FLAG_ERROR_INTEGER_OVERFLOW;
+        result += add;
+    }
+
+    *out = result;
+    return FLAG_NO_ERROR;
+}
+
+int flag_rest_argc_c(Flag_Context *c)
+{
+    return c->rest_argc;
+}
+
+int flag_rest_argc(void)
+{
+    return flag_rest_argc_c(&flag_global_context);
+}
+
+char **flag_rest_argv_c(Flag_Context *c)
+{
+    return c->rest_argv;
+}
+
+char **flag_rest_argv(void)
+{
+    return flag_rest_argv_c(&flag_global_context);
+}
+
+static void flag_list_append(Flag_List *list, char *item)
+{
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity == 0 ? 8 : list->capacity*2;
+        list->items = (char**) realloc(list->items, list->capacity*sizeof(char*));
+        assert(list->items != NULL && "out of memory");
+    }
+    list->items[list->count++] = item;
+}
+
+static void flag_kv_insert(Flag_KV *kv, char *key, char *value)
+{
+    // NOTE: same regime as the flag name index: grow by rehashing once the
+    // table gets half full, so probe chains stay short
+    if (kv->count*2 >= kv->capacity) {
+        size_t new_capacity = kv->capacity == 0 ? 16 : kv->capacity*2;
+        Flag_KV_Entry *new_entries = (Flag_KV_Entry*) calloc(new_capacity, sizeof(Flag_KV_Entry));
+        assert(new_entries != NULL && "out of memory");
+        for (size_t i = 0; i < kv->capacity; ++i) {
+            if (kv->entries[i].key == NULL) continue;
+            size_t slot = (size_t) flag_hash_name(kv->entries[i].key, strlen(kv->entries[i].key)) & (new_capacity - 1);
+            while (new_entries[slot].key != NULL) slot = (slot + 1) & (new_capacity - 1);
+            new_entries[slot] = kv->entries[i];
+        }
+        free(kv->entries);
+        kv->entries = new_entries;
+        kv->capacity = new_capacity;
+    }
+
+    size_t slot = (size_t) flag_hash_name(key, strlen(key)) & (kv->capacity - 1);
+    while (kv->entries[slot].key != NULL) {
+        if (strcmp(kv->entries[slot].key, key) == 0) {
+            kv->entries[slot].value = value;
+            return;
+        }
+        slot = (slot + 1) & (kv->capacity - 1);
+    }
+    kv->entries[slot].key = key;
+    kv->entries[slot].value = value;
+    kv->count += 1;
+}
+
+char *flag_kv_get(Flag_KV *kv, const char *key)
+{
+    if (kv->capacity == 0) return NULL;
+    size_t slot = (size_t) flag_hash_name(key, strlen(key)) & (kv->capacity - 1);
+    while (kv->entries[slot].key != NULL) {
+        if (strcmp(kv->entries[slot].key, key) == 0) return kv->entries[slot].value;
+        slot = (slot + 1) & (kv->capacity - 1);
+    }
+    return NULL;
+}
+
+// NOTE: typed conversion shared by the argv, -flag=value and environment
+// paths. value == NULL means the flag was mentioned without an explicit value,
+// which is only valid for booleans.
+static bool flag_bind_value(Flag_Context *c, Flag *it, char *value)
+{
+    switch (it->type) {
+    case FLAG_BOOL: {
+        if (value != NULL) {
+            if (strcmp(value, "true") == 0) {
+                *(bool*) it->var = true;
+            } else if (strcmp(value, "false") == 0) {
+                *(bool*) it->var = false;
+            } else {
+                c->flag_error = FLAG_ERROR_INVALID_BOOLEAN;
+                c->flag_error_name = it->name;
+                return false;
+            }
+        } else {
+            *(bool*) it->var = true;
+        }
+    }
+    break;
+
+    case FLAG_STR: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(char**) it->var = value;
+    }
+    break;
+
+    case FLAG_UINT64: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        uint64_t result;
+        Flag_Error error = flag_parse_uint64(value, strlen(value), &result);
+        if (error != FLAG_NO_ERROR) {
+            c->flag_error = error;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(uint64_t*) it->var = result;
+    }
+    break;
+
+    case FLAG_INT64: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        int64_t result;
+        Flag_Error error = flag_parse_int64(value, &result);
+        if (error != FLAG_NO_ERROR) {
+            c->flag_error = error;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(int64_t*) it->var = result;
+    }
+    break;
+
+    case FLAG_DOUBLE: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        double result;
+        Flag_Error error = flag_parse_double(value, &result);
+        if (error != FLAG_NO_ERROR) {
+            c->flag_error = error;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(double*) it->var = result;
+    }
+    break;
+
+    case FLAG_SIZE: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        uint64_t result;
+        Flag_Error error = flag_parse_size(value, &result);
+        if (error != FLAG_NO_ERROR) {
+            c->flag_error = error;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(uint64_t*) it->var = result;
+    }
+    break;
+
+    case FLAG_DURATION: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        uint64_t result;
+        Flag_Error error = flag_parse_duration(value, &result);
+        if (error != FLAG_NO_ERROR) {
+            c->flag_error = error;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(uint64_t*) it->var = result;
+    }
+    break;
+
+    case FLAG_STR_LIST: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        flag_list_append((Flag_List*) it->var, value);
+    }
+    break;
+
+    case FLAG_CUSTOM: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        if (!it->custom_fn(value, it->var)) {
+            c->flag_error = FLAG_ERROR_INVALID_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+    }
+    break;
+
+    case FLAG_ENUM: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        FLAG_STAT_INC(c, conversions);
+        size_t value_len = strlen(value);
+        size_t i = 0;
+        while (i < it->choices_count &&
+               !(it->choice_lens[i] == value_len && memcmp(it->choices[i], value, value_len) == 0)) {
+            i += 1;
+        }
+        if (i >= it->choices_count) {
+            c->flag_error = FLAG_ERROR_INVALID_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        *(int*) it->var = (int) i;
+    }
+    break;
+
+    case FLAG_KV: {
+        if (value == NULL) {
+            c->flag_error = FLAG_ERROR_NO_VALUE;
+            c->flag_error_name = it->name;
+            return false;
+        }
+        // NOTE: split key=value at the first '=' in place, same zero-copy
+        // trick as -flag=value tokens. A bare key maps to the empty string,
+        // like a preprocessor -D.
+        char *split = strchr(value, '=');
+        if (split != NULL) {
+            *split = '\0';
+            split += 1;
+        } else {
+            split = (char*) "";
+        }
+        flag_kv_insert((Flag_KV*) it->var, value, split);
+    }
+    break;
+
+    default: {
+        assert(0 && "unreachable");
+        exit(69);
+    }
+    }
+
+    c->provided[it->id/64] |= 1ULL << (it->id%64);
+
+    return true;
+}
+
+bool flag_parse_env_c(Flag_Context *c, const char *prefix)
+{
+    size_t prefix_len = strlen(prefix);
+
+    for (char **env = environ; *env != NULL; ++env) {
+        char *entry = *env;
+        if (strncmp(entry, prefix, prefix_len) != 0) continue;
+
+        char *equals = strchr(entry + prefix_len, '=');
+        if (equals == NULL) continue;
+
+        // NOTE: map FLAG_NAME back to flag-name to look it up in the index
+        size_t name_len = (size_t) (equals - entry) - prefix_len;
+        char name[256];
+        if (name_len >= sizeof(name)) continue;
+        for (size_t i = 0; i < name_len; ++i) {
+            char ch = entry[prefix_len + i];
+            name[i] = ch == '_' ? '-' : (char) tolower((unsigned char) ch);
+        }
+        name[name_len] = '\0';
+
+        Flag *it = flag_lookup(c, name, name_len);
+        // NOTE: just some unrelated variable that happens to share the prefix
+        if (it == NULL) continue;
+
+        // NOTE: PREFIX_FLAG= with an empty value counts as mentioning the flag
+        // without a value, which sets booleans to true
+        if (!flag_bind_value(c, it, equals[1] == '\0' ? NULL : equals + 1)) return false;
+    }
+
+    return true;
+}
+
+bool flag_parse_env(const char *prefix)
+{
+    return flag_parse_env_c(&flag_global_context, prefix);
+}
+
+#define FLAG_SNAPSHOT_MAGIC 0x47414C46u
+#define FLAG_SNAPSHOT_VERSION 1u
+
+static void flag_snap_write(char *buf, size_t cap, size_t *offset, const void *src, size_t n)
+{
+    if (buf != NULL && *offset + n <= cap) memcpy(buf + *offset, src, n);
+    *offset += n;
+}
+
+size_t flag_serialize_c(Flag_Context *c, void *buffer, size_t cap)
+{
+    char *buf = (char*) buffer;
+    size_t offset = 0;
+
+    uint32_t magic = FLAG_SNAPSHOT_MAGIC;
+    uint32_t version = FLAG_SNAPSHOT_VERSION;
+    uint64_t count = (uint64_t) c->flags_count;
+    flag_snap_write(buf, cap, &offset, &magic, sizeof(magic));
+    flag_snap_write(buf, cap, &offset, &version, sizeof(version));
+    flag_snap_write(buf, cap, &offset, &count, sizeof(count));
+
+    for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+    for (size_t i = 0; i < region->count; ++i) {
+        Flag *flag = &region->items[i];
+
+        uint8_t type = (uint8_t) flag->type;
+        flag_snap_write(buf, cap, &offset, &type, sizeof(type));
+
+        switch (flag->type) {
+        case FLAG_BOOL: {
+            uint8_t value = *(bool*) flag->var ? 1 : 0;
+            flag_snap_write(buf, cap, &offset, &value, sizeof(value));
+        }
+        break;
+
+        case FLAG_UINT64:
+        case FLAG_SIZE:
+        case FLAG_DURATION:
+        case FLAG_INT64:
+        case FLAG_DOUBLE: {
+            // NOTE: all of these are 8 bytes of plain old data
+            flag_snap_write(buf, cap, &offset, flag->var, 8);
+        }
+        break;
+
+        case FLAG_STR: {
+            // NOTE: strings carry their bytes (with the terminator), length 0
+            // encodes a NULL value
+            char *value = *(char**) flag->var;
+            uint64_t n = value == NULL ? 0 : (uint64_t) strlen(value) + 1;
+            flag_snap_write(buf, cap, &offset, &n, sizeof(n));
+            if (n > 0) flag_snap_write(buf, cap, &offset, value, (size_t) n);
+        }
+        break;
+
+        case FLAG_STR_LIST: {
+            Flag_List *list = (Flag_List*) flag->var;
+            uint64_t items_count = (uint64_t) list->count;
+            flag_snap_write(buf, cap, &offset, &items_count, sizeof(items_count));
+            for (size_t j = 0; j < list->count; ++j) {
+                uint64_t n = (uint64_t) strlen(list->items[j]) + 1;
+                flag_snap_write(buf, cap, &offset, &n, sizeof(n));
+                flag_snap_write(buf, cap, &offset, list->items[j], (size_t) n);
+            }
+        }
+        break;
+
+        case FLAG_ENUM: {
+            int32_t value = (int32_t) *(int*) flag->var;
+            flag_snap_write(buf, cap, &offset, &value, sizeof(value));
+        }
+        break;
+
+        case FLAG_CUSTOM:
+            // NOTE: the decoded form is opaque to the library, only the type
+            // byte marks the flag's spot in the snapshot
+            break;
+
+        case FLAG_KV: {
+            Flag_KV *kv = (Flag_KV*) flag->var;
+            uint64_t entries_count = (uint64_t) kv->count;
+            flag_snap_write(buf, cap, &offset, &entries_count, sizeof(entries_count));
+            for (size_t j = 0; j < kv->capacity; ++j) {
+                if (kv->entries[j].key == NULL) continue;
+                uint64_t n = (uint64_t) strlen(kv->entries[j].key) + 1;
+                flag_snap_write(buf, cap, &offset, &n, sizeof(n));
+                flag_snap_write(buf, cap, &offset, kv->entries[j].key, (size_t) n);
+                n = (uint64_t) strlen(kv->entries[j].value) + 1;
+                flag_snap_write(buf, cap, &offset, &n, sizeof(n));
+                flag_snap_write(buf, cap, &offset, kv->entries[j].value, (size_t) n);
+            }
+        }
+        break;
+
+        default: {
+            assert(0 && "unreachable");
+            exit(69);
+        }
+        }
+    }
+
+    return offset;
+}
+
+size_t flag_serialize(void *buf, size_t cap)
+{
+    return flag_serialize_c(&flag_global_context, buf, cap);
+}
+
+static bool flag_snap_read(char *buf, size_t len, size_t *offset, void *dst, size_t n)
+{
+    if (*offset + n > len) return false;
+    memcpy(dst, buf + *offset, n);
+    *offset += n;
+    return true;
+}
+
+bool flag_deserialize_c(Flag_Context *c, void *buffer, size_t len)
+{
+    char *buf = (char*) buffer;
+    size_t offset = 0;
+
+    uint32_t magic, version;
+    uint64_t count;
+    if (!flag_snap_read(buf, len, &offset, &magic, sizeof(magic))) return false;
+    if (!flag_snap_read(buf, len, &offset, &version, sizeof(version))) return false;
+    if (!flag_snap_read(buf, len, &offset, &count, sizeof(count))) return false;
+    if (magic != FLAG_SNAPSHOT_MAGIC) return false;
+    if (version != FLAG_SNAPSHOT_VERSION) return false;
+    if (count != (uint64_t) c->flags_count) return false;
+
+    for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+    for (size_t i = 0; i < region->count; ++i) {
+        Flag *flag = &region->items[i];
+
+        uint8_t type;
+        if (!flag_snap_read(buf, len, &offset, &type, sizeof(type))) return false;
+        if (type != (uint8_t) flag->type) return false;
+
+        switch (flag->type) {
+        case FLAG_BOOL: {
+            uint8_t value;
+            if (!flag_snap_read(buf, len, &offset, &value, sizeof(value))) return false;
+            *(bool*) flag->var = value != 0;
+        }
+        break;
+
+        case FLAG_UINT64:
+        case FLAG_SIZE:
+        case FLAG_DURATION:
+        case FLAG_INT64:
+        case FLAG_DOUBLE: {
+            if (!flag_snap_read(buf, len, &offset, flag->var, 8)) return false;
+        }
+        break;
+
+        case FLAG_STR: {
+            uint64_t n;
+            if (!flag_snap_read(buf, len, &offset, &n, sizeof(n))) return false;
+            if (n == 0) {
+                *(char**) flag->var = NULL;
+            } else {
+                if (offset + n > len) return false;
+                // NOTE: zero-copy, the value aliases the snapshot buffer
+                *(char**) flag->var = buf + offset;
+                offset += (size_t) n;
+            }
+        }
+        break;
+
+        case FLAG_STR_LIST: {
+            uint64_t items_count;
+            if (!flag_snap_read(buf, len, &offset, &items_count, sizeof(items_count))) return false;
+            Flag_List *list = (Flag_List*) flag->var;
+            list->count = 0;
+            for (uint64_t j = 0; j < items_count; ++j) {
+                uint64_t n;
+                if (!flag_snap_read(buf, len, &offset, &n, sizeof(n))) return false;
+                if (n == 0 || offset + n > len) return false;
+                flag_list_append(list, buf + offset);
+                offset += (size_t) n;
+            }
+        }
+        break;
+
+        case FLAG_ENUM: {
+            int32_t value;
+            if (!flag_snap_read(buf, len, &offset, &value, sizeof(value))) return false;
+            if (value < 0 || (size_t) value >= flag->choices_count) return false;
+            *(int*) flag->var = (int) value;
+        }
+        break;
+
+        case FLAG_CUSTOM:
+            break;
+
+        case FLAG_KV: {
+            uint64_t entries_count;
+            if (!flag_snap_read(buf, len, &offset, &entries_count, sizeof(entries_count))) return false;
+            Flag_KV *kv = (Flag_KV*) flag->var;
+            // NOTE: a never-populated map still has entries == NULL, and
+            // memset(NULL, 0, 0) is undefined behavior
+            if (kv->entries != NULL) {
+                memset(kv->entries, 0, kv->capacity*sizeof(Flag_KV_Entry));
+            }
+            kv->count = 0;
+            for (uint64_t j = 0; j < entries_count; ++j) {
+                uint64_t n;
+                if (!flag_snap_read(buf, len, &offset, &n, sizeof(n))) return false;
+                if (n == 0 || offset + n > len) return false;
+                char *key = buf + offset;
+                offset += (size_t) n;
+                if (!flag_snap_read(buf, len, &offset, &n, sizeof(n))) return false;
+                if (n == 0 || offset + n > len) return false;
+                flag_kv_insert(kv, key, buf + offset);
+                offset += (size_t) n;
+            }
+        }
+        break;
+
+        default: {
+            assert(0 && "unreachable");
+            exit(69);
+        }
+        }
+    }
+
+    return true;
+}
+
+bool flag_deserialize(void *buf, size_t len)
+{
+    return flag_deserialize_c(&flag_global_context, buf, len);
+}
+
+static void flag_reverse_args(char **argv, size_t n)
+{
+    for (size_t i = 0; i + 1 < n - i; ++i) {
+        char *tmp = argv[i];
+        argv[i] = argv[n - 1 - i];
+        argv[n - 1 - i] = tmp;
+    }
+}
+
+// NOTE: pulls the block of nonopt_count skipped operands starting at *nonopt
+// right up against position w by left-rotating the region between them, the
+// classic three-reversal rotation — pointer swaps only
+static void flag_permute_catch_up(char ***nonopt, int nonopt_count, char **w)
+{
+    size_t gap = (size_t) (w - (*nonopt + nonopt_count));
+    if (gap > 0 && nonopt_count > 0) {
+        flag_reverse_args(*nonopt, (size_t) nonopt_count);
+        flag_reverse_args(*nonopt + nonopt_count, gap);
+        flag_reverse_args(*nonopt, (size_t) nonopt_count + gap);
+    }
+    *nonopt = w - nonopt_count;
+}
+
+static bool flag_parse_loop(Flag_Context *c, int argc, char **argv)
+{
+    flag_shift_args(&argc, &argv);
+
+    // NOTE: expand @file arguments up front into a flattened token array, so
+    // the main loop below only ever sees plain tokens. Everything behind a
+    // -- terminator is rest by contract, so an @word there is a literal
+    // operand, not a file reference
+    bool has_response_files = false;
+    bool terminated = false;
+    for (int i = 0; i < argc && !terminated; ++i) {
+        if (argv[i][0] == '@') {
+            has_response_files = true;
+            break;
+        }
+        terminated = strcmp(argv[i], "--") == 0;
+    }
+    if (has_response_files) {
+        c->response_tokens.count = 0;
+        terminated = false;
+        for (int i = 0; i < argc; ++i) {
+            if (!terminated && argv[i][0] == '@') {
+                if (!flag_expand_response_file(c, argv[i] + 1, 0)) return false;
+            } else {
+                terminated = terminated || strcmp(argv[i], "--") == 0;
+                flag_tokens_append(&c->response_tokens, argv[i]);
+            }
+        }
+        // NOTE: keep the customary NULL at the end of argv, not included in argc
+        flag_tokens_append(&c->response_tokens, NULL);
+        c->response_tokens.count -= 1;
+        argc = (int) c->response_tokens.count;
+        argv = c->response_tokens.items;
+    }
+
+    int argc_total = argc + 1;
+
+    // NOTE: permute mode skips operands in place and keeps them as one
+    // contiguous block that is lazily rotated forward, getopt-style, one
+    // rotation per flag block instead of one memmove per operand
+    char **nonopt = argv;
+    int nonopt_count = 0;
+
+    while (argc > 0) {
+        char *flag = flag_shift_args(&argc, &argv);
+        FLAG_STAT_INC(c, tokens_consumed);
+
+        // NOTE: a bare - is conventionally the stdin operand, not a flag
+        if (*flag != '-' || flag[1] == '\0') {
+            if (c->active_subcommand == NULL) {
+                Flag_Subcommand *sub = NULL;
+                for (size_t i = 0; i < c->subcommands_count; ++i) {
+                    if (strcmp(c->subcommands[i].name, flag) == 0) {
+                        sub = &c->subcommands[i];
+                        break;
+                    }
+                }
+                if (sub != NULL) {
+                    c->active_subcommand = sub->name;
+                    // NOTE: materialize only the chosen command's flags, the
+                    // other subcommands never pay their registration cost
+                    if (sub->register_fn != NULL) sub->register_fn(c);
+                    continue;
+                }
+            }
+
+            if (c->permute) {
+                // NOTE: leave the operand where it is; catching the skipped
+                // block up to it keeps the operands contiguous and in their
+                // original order while the window moves on
+                flag_permute_catch_up(&nonopt, nonopt_count, argv - 1);
+                nonopt_count += 1;
+                continue;
+            }
+
+            // NOTE: pushing flag back into args
+            c->rest_argc = argc + 1;
+            c->rest_argv = argv - 1;
+            return true;
+        }
+
+        if (strcmp(flag, "--") == 0) {
+            // NOTE: but if it's the terminator we don't need to push it back.
+            // In permute mode the skipped operands are pulled up against the
+            // remaining tokens (swallowing the terminator on the way), so
+            // rest is contiguous with the operands first, in original order
+            if (nonopt_count > 0) {
+                flag_permute_catch_up(&nonopt, nonopt_count, argv);
+                argc += nonopt_count;
+                argv = nonopt;
+            }
+            c->rest_argc = argc;
+            c->rest_argv = argv;
+            return true;
+        }
+
+        // NOTE: remove the dash
+        flag += 1;
+
+        // NOTE: support the -flag=value syntax by splitting the token at the
+        // first '=' in place, so the value keeps aliasing the original argv
+        // storage without any copying
+        char *equals = strchr(flag, '=');
+        if (equals != NULL) {
+            *equals = '\0';
+            equals += 1;
+        }
+
+        int flag_argv_index = argc_total - argc - 1;
+
+        Flag *it = flag_lookup(c, flag, strlen(flag));
+        if (it == NULL) {
+            // NOTE: maybe it's a single-char shortcut or a cluster of boolean
+            // ones like -abc. Every char but the last must be a boolean
+            // shortcut; the last one may take a value as usual.
+            size_t n = strlen(flag);
+            bool cluster = n > 0;
+            for (size_t i = 0; cluster && i < n; ++i) {
+                Flag *shortcut = c->short_table[(unsigned char) flag[i]];
+                if (shortcut == NULL) cluster = false;
+                else if (i + 1 < n && shortcut->type != FLAG_BOOL) cluster = false;
+            }
+            if (cluster) {
+                for (size_t i = 0; i + 1 < n; ++i) {
+                    flag_bind_value(c, c->short_table[(unsigned char) flag[i]], NULL);
+                }
+                it = c->short_table[(unsigned char) flag[n - 1]];
+            } else {
+                // NOTE: last chance: an unambiguous GNU-style abbreviation of
+                // a long name, like -cou for -count
+                bool ambiguous = false;
+                it = flag_lookup_prefix(c, flag, n, &ambiguous);
+                if (it == NULL) {
+                    c->flag_error = ambiguous ? FLAG_ERROR_AMBIGUOUS : FLAG_ERROR_UNKNOWN;
+                    c->flag_error_name = flag;
+                    c->flag_error_argv_index = flag_argv_index;
+                    return false;
+                }
+            }
+        }
+
+        char *value = equals;
+        if (it->type != FLAG_BOOL && value == NULL) {
+            if (argc == 0) {
+                c->flag_error = FLAG_ERROR_NO_VALUE;
+                c->flag_error_name = flag;
+                c->flag_error_argv_index = flag_argv_index;
+                return false;
+            }
+            value = flag_shift_args(&argc, &argv);
+            FLAG_STAT_INC(c, tokens_consumed);
+        }
+
+        if (!flag_bind_value(c, it, value)) {
+            c->flag_error_argv_index = flag_argv_index;
+            return false;
+        }
+    }
+
+    // NOTE: everything was consumed; in permute mode the skipped operand
+    // block is what's left over
+    if (nonopt_count > 0) {
+        flag_permute_catch_up(&nonopt, nonopt_count, argv);
+        c->rest_argc = nonopt_count;
+        c->rest_argv = nonopt;
+        return true;
+    }
+
+    c->rest_argc = argc;
+    c->rest_argv = argv;
+    return true;
+}
+
+bool flag_parse_c(Flag_Context *c, int argc, char **argv)
+{
+    c->flag_error = FLAG_NO_ERROR;
+    c->flag_error_name = NULL;
+    c->flag_error_argv_index = 0;
+
+#ifdef FLAG_STATS
+    memset(&c->stats, 0, sizeof(c->stats));
+    struct timespec stats_begin;
+    timespec_get(&stats_begin, TIME_UTC);
+#endif
+
+    bool result = flag_parse_loop(c, argc, argv);
+
+#ifdef FLAG_STATS
+    struct timespec stats_end;
+    timespec_get(&stats_end, TIME_UTC);
+    c->stats.parse_seconds = (double) (stats_end.tv_sec - stats_begin.tv_sec)
+                           + (double) (stats_end.tv_nsec - stats_begin.tv_nsec)*1e-9;
+#endif
+
+    return result;
+}
+
+bool flag_parse(int argc, char **argv)
+{
+    return flag_parse_c(&flag_global_context, argc, argv);
+}
+
+void flag_permute_c(Flag_Context *c, bool enable)
+{
+    c->permute = enable;
+}
+
+void flag_permute(bool enable)
+{
+    flag_permute_c(&flag_global_context, enable);
+}
+
+// NOTE: in-place shell-like tokenizer for flag_parse_buf(). Quote stripping
+// only ever moves bytes backwards, so the buffer is compacted in place and
+// every token (except possibly the last one, see below) gets its terminator
+// written over a byte that was already consumed. An unterminated quote simply
+// runs to the end of the buffer.
+static void flag_tokenize_buf(Flag_Context *c, char *buf, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && isspace((unsigned char) buf[i])) i += 1;
+        if (i >= len) break;
+
+        size_t begin = i;
+        size_t w = i;
+        char quote = '\0';
+        while (i < len && (quote != '\0' || !isspace((unsigned char) buf[i]))) {
+            char x = buf[i];
+            i += 1;
+            if (quote == '\0' && (x == '"' || x == '\'')) {
+                quote = x;
+            } else if (x == quote) {
+                quote = '\0';
+            } else {
+                buf[w] = x;
+                w += 1;
+            }
+        }
+
+        char *token;
+        if (w < len) {
+            // NOTE: when nothing was stripped the terminator lands on the
+            // delimiter itself, which must then be stepped over
+            buf[w] = '\0';
+            if (w == i) i += 1;
+            token = &buf[begin];
+        } else {
+            // NOTE: the token runs up to the very end of the buffer, so there
+            // is no room for the terminator, same edge as in
+            // flag_expand_response_file()
+            size_t n = w - begin;
+            token = (char*) malloc(n + 1);
+            assert(token != NULL && "out of memory");
+            memcpy(token, &buf[begin], n);
+            token[n] = '\0';
+        }
+        flag_tokens_append(&c->buf_tokens, token);
+    }
+}
+
+bool flag_parse_buf_c(Flag_Context *c, char *buf, size_t len, size_t *consumed)
+{
+    c->buf_tokens.count = 0;
+    // NOTE: flag_parse() skips the program name, which a command buffer does
+    // not carry, so slot a placeholder in front
+    static char flag_parse_buf_program[] = "";
+    flag_tokens_append(&c->buf_tokens, flag_parse_buf_program);
+    flag_tokenize_buf(c, buf, len);
+    flag_tokens_append(&c->buf_tokens, NULL);
+    c->buf_tokens.count -= 1;
+
+    if (!flag_parse_c(c, (int) c->buf_tokens.count, c->buf_tokens.items)) return false;
+
+    if (consumed) {
+        if (c->rest_argc > 0 && c->rest_argv[0] >= buf && c->rest_argv[0] < buf + len) {
+            *consumed = (size_t) (c->rest_argv[0] - buf);
+        } else {
+            *consumed = len;
+        }
+    }
+    return true;
+}
+
+bool flag_parse_buf(char *buf, size_t len, size_t *consumed)
+{
+    return flag_parse_buf_c(&flag_global_context, buf, len, consumed);
+}
+
+const Flag_Stats *flag_stats_c(Flag_Context *c)
+{
+    return &c->stats;
+}
+
+const Flag_Stats *flag_stats(void)
+{
+    return flag_stats_c(&flag_global_context);
+}
+
+bool flag_provided_c(Flag_Context *c, void *val)
+{
+    Flag *flag = flag_find_var(c, val);
+    assert(flag != NULL && "flag_provided() expects a pointer obtained from flag registration");
+    return (c->provided[flag->id/64] >> (flag->id%64)) & 1;
+}
+
+bool flag_provided(void *val)
+{
+    return flag_provided_c(&flag_global_context, val);
+}
+
+const char *flag_options_help_c(Flag_Context *c, size_t *len)
+{
+    if (!c->options_help_valid) {
+        Flag_String_Builder *sb = &c->options_help;
+        sb->count = 0;
+
+        for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+        for (size_t i = 0; i < region->count; ++i) {
+            Flag *flag = &region->items[i];
+
+            if (flag->short_name != 0) {
+                flag_sb_appendf(sb, "    -%c, -%s\n", flag->short_name, flag->name);
+            } else {
+                flag_sb_appendf(sb, "    -%s\n", flag->name);
+            }
+            flag_sb_appendf(sb, "        %s\n", flag->desc);
+            switch (flag->type) {
+            case FLAG_BOOL:
+                if (flag->def.as_bool) {
+                    flag_sb_appendf(sb, "        Default: %s\n", flag->def.as_bool ? "true" : "false");
+                }
+                break;
+            case FLAG_UINT64:
+                flag_sb_appendf(sb, "        Default: %" PRIu64 "\n", flag->def.as_uint64);
+                break;
+            case FLAG_STR:
+                if (flag->def.as_str) {
+                    flag_sb_appendf(sb, "        Default: %s\n", flag->def.as_str);
+                }
+                break;
+            case FLAG_INT64:
+                flag_sb_appendf(sb, "        Default: %" PRIi64 "\n", flag->def.as_int64);
+                break;
+            case FLAG_DOUBLE:
+                flag_sb_appendf(sb, "        Default: %g\n", flag->def.as_double);
+                break;
+            case FLAG_SIZE:
+                flag_sb_appendf(sb, "        Default: %" PRIu64 "\n", flag->def.as_uint64);
+                break;
+            case FLAG_DURATION:
+                flag_sb_appendf(sb, "        Default: %" PRIu64 "ns\n", flag->def.as_uint64);
+                break;
+            case FLAG_STR_LIST:
+            case FLAG_KV:
+            case FLAG_CUSTOM:
+                // NOTE: lists, maps and custom targets carry no printable
+                // default
+                break;
+            case FLAG_ENUM:
+                flag_sb_appendf(sb, "        Choices: ");
+                for (size_t j = 0; j < flag->choices_count; ++j) {
+                    flag_sb_appendf(sb, "%s%s", j > 0 ? "|" : "", flag->choices[j]);
+                }
+                flag_sb_appendf(sb, "\n        Default: %s\n", flag->choices[flag->def.as_enum]);
+                break;
+            default:
+                assert(0 && "unreachable");
+                exit(69);
+            }
+        }
+
+        // NOTE: keep the buffer NUL-terminated without counting the NUL, so
+        // it works both as a string and as (items, count) for fwrite
+        flag_sb_appendf(sb, "%s", "");
+        c->options_help_valid = true;
+    }
+
+    if (len != NULL) *len = c->options_help.count;
+    return c->options_help.items == NULL ? "" : c->options_help.items;
+}
+
+const char *flag_options_help(size_t *len)
+{
+    return flag_options_help_c(&flag_global_context, len);
+}
+
+void flag_print_options_c(Flag_Context *c, FILE *stream)
+{
+    size_t len;
+    const char *help = flag_options_help_c(c, &len);
+    fwrite(help, 1, len, stream);
+}
+
+void flag_print_options(FILE *stream)
+{
+    flag_print_options_c(&flag_global_context, stream);
+}
+
+void flag_print_subcommands_c(Flag_Context *c, FILE *stream)
+{
+    for (size_t i = 0; i < c->subcommands_count; ++i) {
+        fprintf(stream, "    %s\n", c->subcommands[i].name);
+        if (c->subcommands[i].desc != NULL) {
+            fprintf(stream, "        %s\n", c->subcommands[i].desc);
+        }
+    }
+}
+
+void flag_print_subcommands(FILE *stream)
+{
+    flag_print_subcommands_c(&flag_global_context, stream);
+}
+
+// NOTE: shell word with anything that would break the script syntax (quotes,
+// brackets, the zsh spec separators) blanked out; flag names and descs in
+// practice never contain these, this just keeps a weird desc from producing a
+// broken script
+static void flag_completion_escape(FILE *stream, const char *s)
+{
+    for (; *s != '\0'; ++s) {
+        char x = *s;
+        if (x == '[' || x == ']' || x == ':' || x == '\'' || x == '"' || x == '\n') x = ' ';
+        fputc(x, stream);
+    }
+}
+
+bool flag_print_completion_c(Flag_Context *c, FILE *stream, const char *shell, const char *program)
+{
+    if (strcmp(shell, "bash") == 0) {
+        fprintf(stream, "# bash completion for %s, generated by flag.h\n", program);
+        fprintf(stream, "_%s_completions()\n{\n", program);
+        fprintf(stream, "    local cur=\"${COMP_WORDS[COMP_CWORD]}\"\n");
+        fprintf(stream, "    local prev=\"${COMP_WORDS[COMP_CWORD-1]}\"\n");
+        fprintf(stream, "    case \"$prev\" in\n");
+        for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+        for (size_t i = 0; i < region->count; ++i) {
+            Flag *flag = &region->items[i];
+            if (flag->type != FLAG_ENUM) continue;
+            fprintf(stream, "        -%s) COMPREPLY=($(compgen -W \"", flag->name);
+            for (size_t j = 0; j < flag->choices_count; ++j) {
+                fprintf(stream, "%s%s", j > 0 ? " " : "", flag->choices[j]);
+            }
+            fprintf(stream, "\" -- \"$cur\")); return ;;\n");
+        }
+        fprintf(stream, "    esac\n");
+        fprintf(stream, "    if [[ \"$cur\" == -* ]]; then\n");
+        fprintf(stream, "        COMPREPLY=($(compgen -W \"");
+        bool first = true;
+        for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+        for (size_t i = 0; i < region->count; ++i) {
+            Flag *flag = &region->items[i];
+            fprintf(stream, "%s-%s", first ? "" : " ", flag->name);
+            first = false;
+            if (flag->short_name != '\0') fprintf(stream, " -%c", flag->short_name);
+        }
+        fprintf(stream, "\" -- \"$cur\"))\n");
+        if (c->subcommands_count > 0) {
+            fprintf(stream, "    elif [[ $COMP_CWORD == 1 ]]; then\n");
+            fprintf(stream, "        COMPREPLY=($(compgen -W \"");
+            for (size_t i = 0; i < c->subcommands_count; ++i) {
+                fprintf(stream, "%s%s", i > 0 ? " " : "", c->subcommands[i].name);
+            }
+            fprintf(stream, "\" -- \"$cur\"))\n");
+        }
+        fprintf(stream, "    fi\n}\n");
+        fprintf(stream, "complete -o default -F _%s_completions %s\n", program, program);
+        return true;
+    }
+
+    if (strcmp(shell, "zsh") == 0) {
+        fprintf(stream, "#compdef %s\n", program);
+        fprintf(stream, "# zsh completion for %s, generated by flag.h\n", program);
+        fprintf(stream, "_arguments \\\n");
+        for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+        for (size_t i = 0; i < region->count; ++i) {
+            Flag *flag = &region->items[i];
+            fprintf(stream, "    '-%s[", flag->name);
+            flag_completion_escape(stream, flag->desc);
+            fprintf(stream, "]");
+            switch (flag->type) {
+            case FLAG_BOOL:
+                break;
+            case FLAG_ENUM:
+                fprintf(stream, ":%s:(", flag->name);
+                for (size_t j = 0; j < flag->choices_count; ++j) {
+                    fprintf(stream, "%s%s", j > 0 ? " " : "", flag->choices[j]);
+                }
+                fprintf(stream, ")");
+                break;
+            case FLAG_STR:
+                fprintf(stream, ":file:_files");
+                break;
+            default:
+                fprintf(stream, ":value:");
+                break;
+            }
+            fprintf(stream, "' \\\n");
+        }
+        fprintf(stream, "    '*::arg:_files'\n");
+        return true;
+    }
+
+    return false;
+}
+
+bool flag_print_completion(FILE *stream, const char *shell, const char *program)
+{
+    return flag_print_completion_c(&flag_global_context, stream, shell, program);
+}
+
+#define FLAG_SUGGEST_NAME_MAX 64
+
+static size_t flag_edit_distance(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    // NOTE: textbook two-row Levenshtein; flag names are short so one row on
+    // the stack is plenty
+    assert(b_len <= FLAG_SUGGEST_NAME_MAX);
+    size_t row[FLAG_SUGGEST_NAME_MAX + 1];
+    for (size_t j = 0; j <= b_len; ++j) row[j] = j;
+
+    for (size_t i = 1; i <= a_len; ++i) {
+        size_t diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b_len; ++j) {
+            size_t subst = diag + (a[i - 1] == b[j - 1] ? 0 : 1);
+            size_t insert = row[j - 1] + 1;
+            size_t del = row[j] + 1;
+            diag = row[j];
+            row[j] = subst < insert ? subst : insert;
+            if (del < row[j]) row[j] = del;
+        }
+    }
+    return row[b_len];
+}
+
+// NOTE: the nearest registered name to an unknown token, or NULL if nothing
+// is plausibly close. The precomputed bigram signatures shortlist candidates
+// with an AND and a popcount each; only names sharing at least half their
+// bigrams with the token get the edit distance treatment, and the winner must
+// still land within a third of the token's length in edits.
+static Flag *flag_suggest(Flag_Context *c, const char *name)
+{
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > FLAG_SUGGEST_NAME_MAX) return NULL;
+    uint64_t sig = flag_bigram_signature(name, name_len);
+    int sig_count = flag_popcount64(sig);
+
+    Flag *best = NULL;
+    size_t best_dist = name_len/3 + 2;
+    for (Flag_Region *region = c->regions; region != NULL; region = region->next)
+    for (size_t i = 0; i < region->count; ++i) {
+        Flag *flag = &region->items[i];
+        if (flag->name_len > FLAG_SUGGEST_NAME_MAX) continue;
+
+        int flag_count = flag_popcount64(flag->bigrams);
+        int shared = flag_popcount64(sig & flag->bigrams);
+        int smaller = sig_count < flag_count ? sig_count : flag_count;
+        if (shared*2 < smaller) continue;
+
+        size_t dist = flag_edit_distance(name, name_len, flag->name, flag->name_len);
+        if (dist < best_dist) {
+            best = flag;
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
+void flag_print_error_c(Flag_Context *c, FILE *stream)
+{
+    switch (c->flag_error) {
+    case FLAG_NO_ERROR:
+        // NOTE: don't call flag_print_error() if flag_parse() didn't return false, okay? ._.
+        fprintf(stream, "Operation Failed Successfully! Please tell the developer of this software that they don't know what they are doing! :)");
+        break;
+    case FLAG_ERROR_UNKNOWN: {
+        fprintf(stream, "ERROR: -%s: unknown flag", c->flag_error_name);
+        Flag *suggestion = flag_suggest(c, c->flag_error_name);
+        if (suggestion != NULL) {
+            fprintf(stream, " (did you mean -%s?)", suggestion->name);
+        }
+        fprintf(stream, "\n");
+    }
+    break;
+    case FLAG_ERROR_AMBIGUOUS:
+        fprintf(stream, "ERROR: -%s: ambiguous flag abbreviation\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_INVALID_VALUE:
+        fprintf(stream, "ERROR: -%s: invalid value\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_NO_VALUE:
+        fprintf(stream, "ERROR: -%s: no value provided\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_INVALID_NUMBER:
+        fprintf(stream, "ERROR: -%s: invalid number\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_INTEGER_OVERFLOW:
+        fprintf(stream, "ERROR: -%s: integer overflow\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_INVALID_BOOLEAN:
+        fprintf(stream, "ERROR: -%s: invalid boolean value\n", c->flag_error_name);
+        break;
+    case FLAG_ERROR_RESPONSE_FILE:
+        fprintf(stream, "ERROR: @%s: could not read response file\n", c->flag_error_name);
+        break;
+    default:
+        assert(0 && "unreachable");
+        exit(69);
+    }
+}
+
+void flag_print_error(FILE *stream)
+{
+    flag_print_error_c(&flag_global_context, stream);
+}
+
+Flag_Error flag_error_c(Flag_Context *c)
+{
+    return c->flag_error;
+}
+
+Flag_Error flag_error(void)
+{
+    return flag_error_c(&flag_global_context);
+}
+
+char *flag_error_name_c(Flag_Context *c)
+{
+    return c->flag_error_name;
+}
+
+char *flag_error_name(void)
+{
+    return flag_error_name_c(&flag_global_context);
+}
+
+int flag_error_argv_index_c(Flag_Context *c)
+{
+    return c->flag_error_argv_index;
+}
+
+int flag_error_argv_index(void)
+{
+    return flag_error_argv_index_c(&flag_global_context);
+}
+
+#ifdef __cplusplus
+void flag_register_defs_c(Flag_Context *c, const Flag_Def *defs, size_t defs_count)
+{
+    for (size_t i = 0; i < defs_count; ++i) {
+        const Flag_Def *def = &defs[i];
+        // NOTE: name length and hash come straight out of the constexpr table,
+        // registration does no string work at all
+        Flag *flag = flag_new_precomputed(c, def->type, def->name, def->name_len, def->name_hash, def->desc);
+        if (def->var != NULL) flag->var = def->var;
+
+        switch (def->type) {
+        case FLAG_BOOL:
+            flag->def.as_bool = def->def_bool;
+            *(bool*) flag->var = def->def_bool;
+            break;
+        case FLAG_UINT64:
+        case FLAG_SIZE:
+            flag->def.as_uint64 = def->def_uint64;
+            *(uint64_t*) flag->var = def->def_uint64;
+            break;
+        case FLAG_STR:
+            flag->def.as_str = (char*) def->def_str;
+            *(char**) flag->var = (char*) def->def_str;
+            break;
+        case FLAG_INT64:
+            flag->def.as_int64 = def->def_int64;
+            *(int64_t*) flag->var = def->def_int64;
+            break;
+        case FLAG_DOUBLE:
+            flag->def.as_double = def->def_double;
+            *(double*) flag->var = def->def_double;
+            break;
+        default:
+            assert(0 && "unreachable");
+            exit(69);
+        }
+    }
+}
+
+void flag_register_defs(const Flag_Def *defs, size_t defs_count)
+{
+    flag_register_defs_c(&flag_global_context, defs, defs_count);
 }
+#endif // __cplusplus
 
 #endif
 // Copyright 2021 Alexey Kutepov <reximkut@gmail.com>